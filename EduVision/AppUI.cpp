@@ -1,4 +1,5 @@
 #include "AppUI.hpp"
+#include "VideoSurface.hpp"
 #include "imgui.h"
 #include "imgui_impl_glfw.h"
 #include "imgui_impl_opengl3.h"
@@ -13,16 +14,16 @@
 #endif
 
 
-AppUI::AppUI(UserRepository& dataBase, FaceRecognizer& recognizer, cv::CascadeClassifier& face_cascade, std::vector<matrix<float, 0, 1>>& face_descriptors, std::vector<int>& labels)
-    : dataBase(dataBase), recognizer(recognizer), face_cascade(face_cascade), face_descriptors(face_descriptors), labels(labels) {
+AppUI::AppUI(UserRepository& dataBase, FaceRecognizer& recognizer, SharedGallery& gallery, std::vector<CameraManager::Source> sources, size_t recognition_workers,
+    RecognitionScheduler::Params scheduling, double cpu_budget)
+    : dataBase(dataBase), recognizer(recognizer), gallery(gallery), sources(std::move(sources)), recognition_workers(recognition_workers),
+    scheduling(scheduling), cpu_budget(cpu_budget) {
 }
 
 void AppUI::start() {
-    // Initialize OpenCV video capture
-    cv::VideoCapture cap(0, cv::CAP_DSHOW);
-    if (!cap.isOpened()) {
-        throw std::runtime_error("Error opening video stream");
-    }
+    // Open every camera and load the models of the recognition workers
+    CameraManager cameras(recognizer, gallery, sources, recognition_workers, scheduling, cpu_budget);
+    int selected_camera = 0;
 
     // Initialize GLFW
     if (!glfwInit()) {
@@ -56,19 +57,36 @@ void AppUI::start() {
     ImFont* font_medium = io.Fonts->AddFontFromFileTTF("fonts/Helvetica.ttf", 24.0f);
     ImFont* font_small = io.Fonts->AddFontFromFileTTF("fonts/Helvetica.ttf", 16.0f);
 
-    // Start face recognition thread
-    std::atomic<bool> stop_flag{ false };
-    std::thread recognition_thread(&FaceRecognizer::recognizeFaces, &recognizer, std::ref(face_cascade), std::ref(face_descriptors), std::ref(labels), std::ref(stop_flag));
+    // Start capture threads and face recognition workers
+    cameras.start();
+
+    // The selected camera's frames, streamed into one texture kept across frames
+    VideoSurface video_surface;
+    int shown_camera = -1;
+    uint64_t shown_sequence = 0;
 
     bool show_group_attendance_popup = false;
     bool group_attendance_error = false;
-    std::vector<User> group_users;
+    // Reports are built when queried and rebuilt only when the repository reports a change
+    AttendanceReport group_report;
+    std::string group_report_name;
+    int group_report_days = 0;
 
     bool show_student_attendance_popup = false;
     bool student_attendance_error = false;
     std::optional<User> selected_student;
+    AttendanceReport student_report;
+
+    auto days_range = [](int days) -> std::optional<AttendanceRange> {
+        if (days <= 0) {
+            return std::nullopt;
+        }
+        std::time_t now = std::time(nullptr);
+        return AttendanceRange{ now - static_cast<std::time_t>(days) * 24 * 60 * 60, now + 1 };
+    };
 
     char group_attendance[96] = "";
+    int group_attendance_days = 0; // 0 shows the whole history
     char student_attendance[96] = "";
 
     bool show_add_student_popup = false;
@@ -81,40 +99,41 @@ void AppUI::start() {
     bool user_created = false;
     int new_user_id = -1;
 
+    bool show_remove_student_popup = false;
+    char remove_surname[96] = "";
+    char remove_name[96] = "";
+
+    // Enrollment runs next to recognition, which switches to the new gallery snapshot when it is published
+    std::thread enrollment_thread;
+    std::atomic<bool> enrollment_running{ false };
+    std::mutex enrollment_mutex;
+    std::string enrollment_status;
+
     while (!glfwWindowShouldClose(window)) {
         glfwPollEvents();
 
+        if (!cameras.isCapturing()) {
+            break;
+        }
+        // Upload the frame to the texture when it is new. The camera's slot is released right after, before rendering.
+        // Capture runs on its own threads, the UI only shows the latest frame at its own rate.
+        // A camera that opened but delivers no frames still gets the UI drawn, with a placeholder for the video.
         {
-            std::lock_guard<std::mutex> lock(recognizer.frame_mutex);
-            cap >> recognizer.current_frame;
-            if (recognizer.current_frame.empty()) {
-                stop_flag = true;
-                break;
+            FrameBuffer<CameraManager::Frame>::Lease frame = cameras.latestFrame(selected_camera);
+            if (frame && (shown_camera != selected_camera || shown_sequence != frame.sequence())) {
+                video_surface.update(frame->image);
+                shown_camera = selected_camera;
+                shown_sequence = frame.sequence();
             }
         }
+        const bool has_signal = shown_camera == selected_camera;
+        const ImVec2 video_size = has_signal
+            ? ImVec2((float)video_surface.width(), (float)video_surface.height())
+            : ImVec2(640.0f, 480.0f);
 
-        recognizer.new_frame_ready = true;
-        recognizer.frame_cond.notify_one();
-
-        std::vector<std::string> recognized_users = recognizer.updated_users;
+        std::vector<std::string> recognized_users = recognizer.getUpdatedUsers();
 
         {
-            std::lock_guard<std::mutex> lock(recognizer.frame_mutex);
-
-            // Convert the frame to RGBA
-            cv::Mat frame_rgba;
-            cv::cvtColor(recognizer.current_frame, frame_rgba, cv::COLOR_BGR2RGBA);
-
-            // Create a texture from the frame
-            GLuint texture;
-            glGenTextures(1, &texture);
-            glBindTexture(GL_TEXTURE_2D, texture);
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, frame_rgba.cols, frame_rgba.rows, 0, GL_RGBA, GL_UNSIGNED_BYTE, frame_rgba.data);
-
             // Start the ImGui frame
             ImGui_ImplOpenGL3_NewFrame();
             ImGui_ImplGlfw_NewFrame();
@@ -137,7 +156,19 @@ void AppUI::start() {
             ImGui::Dummy(ImVec2(0.0f, 12.0f));
 
             // Display the frame as an image
-            ImGui::Image((void*)(intptr_t)texture, ImVec2((float)frame_rgba.cols, (float)frame_rgba.rows));
+            if (has_signal) {
+                ImGui::Image((void*)(intptr_t)video_surface.texture(), video_size);
+            }
+            else {
+                ImGui::BeginChild("##no_signal", video_size, true);
+                ImGui::Text("No signal from %s", cameras.getCameraName(selected_camera).c_str());
+                ImGui::EndChild();
+            }
+
+            CameraManager::CaptureStats capture_stats = cameras.getCaptureStats(selected_camera);
+            ImGui::PushFont(font_small);
+            ImGui::Text("Capture %.1f fps, decoded %.1f fps", capture_stats.grab_fps, capture_stats.decode_fps);
+            ImGui::PopFont();
 
             ImGui::Dummy(ImVec2(0.0f, 16.0f));
 
@@ -152,8 +183,8 @@ void AppUI::start() {
 
             ImGuiWindowFlags controls_window_flags = ImGuiWindowFlags_NoMove | ImGuiWindowFlags_NoResize | ImGuiWindowFlags_NoCollapse | ImGuiWindowFlags_NoTitleBar | ImGuiWindowFlags_NoBackground;
 
-            ImGui::SetNextWindowSize(ImVec2((float)(display_w - frame_rgba.cols - 40), (float)frame_rgba.rows));
-            ImGui::SetNextWindowPos(ImVec2((float)frame_rgba.cols + 40, 0));
+            ImGui::SetNextWindowSize(ImVec2((float)display_w - video_size.x - 40, video_size.y));
+            ImGui::SetNextWindowPos(ImVec2(video_size.x + 40, 0));
 
             // Create a new window for input fields and buttons
             ImGui::Begin("Controls", nullptr, controls_window_flags);
@@ -168,17 +199,37 @@ void AppUI::start() {
 
             ImGui::PushFont(font_medium);
 
+            if (cameras.getCameraCount() > 1) {
+                ImGui::Text("Camera");
+                ImGui::SameLine();
+                if (ImGui::BeginCombo("##camera", cameras.getCameraName(selected_camera).c_str())) {
+                    for (size_t i = 0; i < cameras.getCameraCount(); ++i) {
+                        if (ImGui::Selectable(cameras.getCameraName(i).c_str(), selected_camera == static_cast<int>(i))) {
+                            selected_camera = static_cast<int>(i);
+                        }
+                    }
+                    ImGui::EndCombo();
+                }
+                ImGui::Dummy(ImVec2(0.0f, 4.0f));
+            }
+
             // Group attendance input field and button
             ImGui::Text("Group attendance");
             ImGui::SameLine();
             ImGui::PushStyleVar(ImGuiStyleVar_FramePadding, ImVec2(4, 4));
             ImGui::InputText("##group_attendance", group_attendance, IM_ARRAYSIZE(group_attendance));
+            ImGui::Text("Last days (0 = all)");
+            ImGui::SameLine();
+            ImGui::SetNextItemWidth(120.0f);
+            ImGui::InputInt("##group_attendance_days", &group_attendance_days);
             ImGui::PopStyleVar();
             ImGui::Dummy(ImVec2(0.0f, 4.0f));
             ImGui::PushStyleVar(ImGuiStyleVar_FramePadding, ImVec2(16, 8));
             if (ImGui::Button("Get##group")) {
-                group_users = dataBase.getAllByGroup(group_attendance);
-                if (group_users.empty()) {
+                group_report_name = group_attendance;
+                group_report_days = group_attendance_days;
+                group_report = dataBase.getGroupReport(group_report_name, days_range(group_report_days));
+                if (group_report.rows.empty()) {
                     group_attendance_error = true;
                 }
                 else {
@@ -198,54 +249,26 @@ void AppUI::start() {
                         ImGui::PopStyleColor();
                     }
                     else {
-                        std::map<std::time_t, int> date_map;
-                        for (const auto& user : group_users) {
-                            for (const auto& attendance : user.getAttendance()) {
-                                std::tm* tm_ptr = std::localtime(&attendance);
-                                tm_ptr->tm_sec = 0;
-                                tm_ptr->tm_min = 0;
-                                tm_ptr->tm_hour = 0;
-                                std::time_t date = std::mktime(tm_ptr);
-                                date_map[date]++;
-                            }
-                        }
-
-                        std::vector<std::time_t> sorted_dates;
-                        for (const auto& entry : date_map) {
-                            sorted_dates.push_back(entry.first);
+                        if (group_report.version != dataBase.reportVersion()) {
+                            group_report = dataBase.getGroupReport(group_report_name, days_range(group_report_days));
                         }
 
-                        if (ImGui::BeginTable("GroupAttendanceTable", 1 + sorted_dates.size(), ImGuiTableFlags_ScrollY)) {
+                        if (ImGui::BeginTable("GroupAttendanceTable", 1 + group_report.days.size(), ImGuiTableFlags_ScrollY)) {
                             ImGui::TableSetupColumn("Name");
 
-                            for (const auto& date : sorted_dates) {
-                                std::tm* tm_ptr = std::localtime(&date);
-                                char date_str[20];
-                                std::strftime(date_str, sizeof(date_str), "%Y-%m-%d", tm_ptr);
-                                ImGui::TableSetupColumn(date_str);
+                            for (const auto& label : group_report.day_labels) {
+                                ImGui::TableSetupColumn(label.c_str());
                             }
                             ImGui::TableHeadersRow();
 
-                            for (const auto& user : group_users) {
+                            for (const auto& row : group_report.rows) {
                                 ImGui::TableNextRow();
                                 ImGui::TableSetColumnIndex(0);
-                                std::string full_name = user.getSurname() + " " + user.getName() + " " + user.getPatronymic();
-                                ImGui::Text("%s", full_name.c_str());
-
-                                std::map<std::time_t, int> user_attendance_map;
-                                for (const auto& attendance : user.getAttendance()) {
-                                    std::tm* tm_ptr = std::localtime(&attendance);
-                                    tm_ptr->tm_sec = 0;
-                                    tm_ptr->tm_min = 0;
-                                    tm_ptr->tm_hour = 0;
-                                    std::time_t date = std::mktime(tm_ptr);
-                                    user_attendance_map[date]++;
-                                }
+                                ImGui::Text("%s", row.full_name.c_str());
 
-                                for (size_t i = 0; i < sorted_dates.size(); ++i) {
+                                for (size_t i = 0; i < row.counts.size(); ++i) {
                                     ImGui::TableSetColumnIndex(i + 1);
-                                    int count = user_attendance_map[sorted_dates[i]];
-                                    ImGui::Text("%d", count);
+                                    ImGui::Text("%d", row.counts[i]);
                                 }
                             }
 
@@ -291,6 +314,7 @@ void AppUI::start() {
                 }
                 else {
                     student_attendance_error = false;
+                    student_report = dataBase.getUserReport(selected_student->getId());
                 }
                 show_student_attendance_popup = true;
                 ImGui::OpenPopup("Student Attendance");
@@ -305,46 +329,28 @@ void AppUI::start() {
                         ImGui::PopStyleColor();
                     }
                     else if (selected_student) {
-                        const User& user = *selected_student;
-
-                        //    
-                        std::map<std::time_t, int> date_map;
-                        for (const auto& attendance : user.getAttendance()) {
-                            std::tm* tm_ptr = std::localtime(&attendance);
-                            tm_ptr->tm_sec = 0;
-                            tm_ptr->tm_min = 0;
-                            tm_ptr->tm_hour = 0;
-                            std::time_t date = std::mktime(tm_ptr);
-                            date_map[date]++;
-                        }
-
-                        //  map    
-                        std::vector<std::time_t> sorted_dates;
-                        for (const auto& entry : date_map) {
-                            sorted_dates.push_back(entry.first);
+                        if (student_report.version != dataBase.reportVersion()) {
+                            student_report = dataBase.getUserReport(selected_student->getId());
                         }
 
                         //  
-                        if (ImGui::BeginTable("StudentAttendanceTable", 1 + sorted_dates.size(), ImGuiTableFlags_ScrollY)) {
+                        if (ImGui::BeginTable("StudentAttendanceTable", 1 + student_report.days.size(), ImGuiTableFlags_ScrollY)) {
                             ImGui::TableSetupColumn("Date");
 
-                            for (const auto& date : sorted_dates) {
-                                std::tm* tm_ptr = std::localtime(&date);
-                                char date_str[20];
-                                std::strftime(date_str, sizeof(date_str), "%Y-%m-%d", tm_ptr);
-                                ImGui::TableSetupColumn(date_str);
+                            for (const auto& label : student_report.day_labels) {
+                                ImGui::TableSetupColumn(label.c_str());
                             }
                             ImGui::TableHeadersRow();
 
-                            ImGui::TableNextRow();
-                            ImGui::TableSetColumnIndex(0);
-                            std::string full_name = user.getSurname() + " " + user.getName() + " " + user.getPatronymic();
-                            ImGui::Text("%s", full_name.c_str());
+                            for (const auto& row : student_report.rows) {
+                                ImGui::TableNextRow();
+                                ImGui::TableSetColumnIndex(0);
+                                ImGui::Text("%s", row.full_name.c_str());
 
-                            for (size_t i = 0; i < sorted_dates.size(); ++i) {
-                                ImGui::TableSetColumnIndex(i + 1);
-                                int count = date_map[sorted_dates[i]];
-                                ImGui::Text("%d", count);
+                                for (size_t i = 0; i < row.counts.size(); ++i) {
+                                    ImGui::TableSetColumnIndex(i + 1);
+                                    ImGui::Text("%d", row.counts[i]);
+                                }
                             }
 
                             ImGui::EndTable();
@@ -371,11 +377,6 @@ void AppUI::start() {
             ImGui::PushStyleVar(ImGuiStyleVar_FramePadding, ImVec2(16, 8));
             // Add new student button
             if (ImGui::Button("Add new student")) {
-                stop_flag = true;
-                recognizer.frame_cond.notify_one();
-                if (recognition_thread.joinable()) {
-                    recognition_thread.join();
-                }
                 show_add_student_popup = true;
                 ImGui::OpenPopup("Add New Student");
             }
@@ -402,22 +403,97 @@ void AppUI::start() {
                     if (user_created) {
                         ImGui::Text("User created successfully. ID: %d", new_user_id);
                         ImGui::Text("Please upload user's photos. Path:person_data/%d/", new_user_id);
-                        if (ImGui::Button("I've uploaded photos")) {
-                            if (ImGui::Button("Add user in Recognizer")) {
+                        if (enrollment_running) {
+                            ImGui::Text("Adding user to recognizer...");
+                        }
+                        else if (ImGui::Button("I've uploaded photos")) {
+                            if (enrollment_thread.joinable()) {
+                                enrollment_thread.join();
+                            }
+                            enrollment_running = true;
+                            enrollment_thread = std::thread([this, &enrollment_running, &enrollment_mutex, &enrollment_status, user_id = new_user_id] {
+                                std::string status;
                                 try {
-                                    recognizer.addUserToModel(new_user_id);
-                                    show_add_student_popup = false;
+                                    recognizer.addUserToModel(user_id, gallery);
+                                    status = "User " + std::to_string(user_id) + " added to recognizer";
                                 }
                                 catch (const std::exception& e) {
-                                    ImGui::Text("Error adding user to recognizer: %s", e.what());
+                                    status = std::string("Error adding user to recognizer: ") + e.what();
                                 }
-                            }
+                                std::lock_guard<std::mutex> lock(enrollment_mutex);
+                                enrollment_status = status;
+                                enrollment_running = false;
+                            });
+                        }
+                        std::lock_guard<std::mutex> lock(enrollment_mutex);
+                        if (!enrollment_status.empty()) {
+                            ImGui::Text("%s", enrollment_status.c_str());
                         }
                     }
                     if (ImGui::Button("Close")) {
                         show_add_student_popup = false;
-                        stop_flag = false;
-                        recognition_thread = std::thread(&FaceRecognizer::recognizeFaces, &recognizer, std::ref(face_cascade), std::ref(face_descriptors), std::ref(labels), std::ref(stop_flag));
+                        user_created = false;
+                        std::lock_guard<std::mutex> lock(enrollment_mutex);
+                        enrollment_status.clear();
+                    }
+                    ImGui::EndPopup();
+                }
+            }
+
+            ImGui::SameLine();
+            // Remove student button
+            if (ImGui::Button("Remove student")) {
+                show_remove_student_popup = true;
+                ImGui::OpenPopup("Remove Student");
+            }
+
+            if (show_remove_student_popup) {
+                ImGui::SetNextWindowSize(ImVec2(800, 600));
+                if (ImGui::BeginPopupModal("Remove Student", &show_remove_student_popup, ImGuiWindowFlags_AlwaysAutoResize | ImGuiWindowFlags_AlwaysVerticalScrollbar)) {
+                    ImGui::InputText("Surname", remove_surname, IM_ARRAYSIZE(remove_surname));
+                    ImGui::InputText("Name", remove_name, IM_ARRAYSIZE(remove_name));
+                    if (enrollment_running) {
+                        ImGui::Text("Updating recognizer...");
+                    }
+                    else if (ImGui::Button("Remove User")) {
+                        std::optional<User> user = dataBase.findUserByFullName(remove_name, remove_surname);
+                        if (!user) {
+                            std::lock_guard<std::mutex> lock(enrollment_mutex);
+                            enrollment_status = "Wrong user name";
+                        }
+                        else {
+                            if (enrollment_thread.joinable()) {
+                                enrollment_thread.join();
+                            }
+                            // Shares the enrollment thread, so the descriptor files are written by one thread at a time
+                            enrollment_running = true;
+                            enrollment_thread = std::thread([this, &enrollment_running, &enrollment_mutex, &enrollment_status, user_id = user->getId()] {
+                                std::string status;
+                                try {
+                                    // Recognition stops matching the user before the records go
+                                    recognizer.removeUserFromModel(user_id, gallery);
+                                    dataBase.remove(user_id);
+                                    status = "User " + std::to_string(user_id) + " removed";
+                                }
+                                catch (const std::exception& e) {
+                                    status = std::string("Error removing user: ") + e.what();
+                                }
+                                std::lock_guard<std::mutex> lock(enrollment_mutex);
+                                enrollment_status = status;
+                                enrollment_running = false;
+                            });
+                        }
+                    }
+                    {
+                        std::lock_guard<std::mutex> lock(enrollment_mutex);
+                        if (!enrollment_status.empty()) {
+                            ImGui::Text("%s", enrollment_status.c_str());
+                        }
+                    }
+                    if (ImGui::Button("Close")) {
+                        show_remove_student_popup = false;
+                        std::lock_guard<std::mutex> lock(enrollment_mutex);
+                        enrollment_status.clear();
                     }
                     ImGui::EndPopup();
                 }
@@ -437,24 +513,20 @@ void AppUI::start() {
             ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
 
             glfwSwapBuffers(window);
-
-            // Cleanup texture
-            glDeleteTextures(1, &texture);
         }
 
-        if (cv::waitKey(30) == 27) {
-            stop_flag = true;
-            recognizer.frame_cond.notify_one();
+        if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS) {
             break;
         }
     }
 
-    stop_flag = true;
-    recognizer.frame_cond.notify_one();
-    if (recognition_thread.joinable()) {
-        recognition_thread.join();
+    cameras.stop();
+    if (enrollment_thread.joinable()) {
+        enrollment_thread.join();
     }
-    cap.release();
+
+    // Cleanup texture, while the GL context still exists
+    video_surface.release();
 
     // Cleanup ImGui
     ImGui_ImplOpenGL3_Shutdown();
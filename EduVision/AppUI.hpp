@@ -1,16 +1,20 @@
 #pragma once
 
 #include "FaceRecognition.hpp"
+#include "CameraManager.hpp"
 
 class AppUI {
 public:
-    AppUI(UserRepository& dataBase, FaceRecognizer& recognizer, cv::CascadeClassifier& face_cascade, std::vector<matrix<float, 0, 1>>& face_descriptors, std::vector<int>& labels);
+    AppUI(UserRepository& dataBase, FaceRecognizer& recognizer, SharedGallery& gallery, std::vector<CameraManager::Source> sources, size_t recognition_workers = 0,
+        RecognitionScheduler::Params scheduling = {}, double cpu_budget = 0.0);
     void start();
 
 private:
     UserRepository& dataBase;
     FaceRecognizer& recognizer;
-    cv::CascadeClassifier& face_cascade;
-    std::vector<matrix<float, 0, 1>>& face_descriptors;
-    std::vector<int>& labels;
+    SharedGallery& gallery;
+    std::vector<CameraManager::Source> sources;
+    size_t recognition_workers;
+    RecognitionScheduler::Params scheduling;
+    double cpu_budget;
 };
\ No newline at end of file
@@ -0,0 +1,128 @@
+#define _SILENCE_CXX17_CODECVT_HEADER_DEPRECATION_WARNING
+#define _SILENCE_ALL_CXX17_DEPRECATION_WARNINGS
+#define _CRT_SECURE_NO_WARNINGS
+
+#include "AttendanceWriter.hpp"
+#include "Metrics.hpp"
+
+#include <algorithm>
+#include <iostream>
+
+namespace {
+    // Writes tried on destruction before the remaining records are given up
+    constexpr int SHUTDOWN_ATTEMPTS = 3;
+}
+
+AttendanceWriter::AttendanceWriter(WriteBatch write_batch, size_t batch_size, std::chrono::milliseconds interval)
+    : write_batch(std::move(write_batch)), batch_size(batch_size > 0 ? batch_size : 1), interval(interval) {
+    thread = std::thread(&AttendanceWriter::run, this);
+}
+
+AttendanceWriter::~AttendanceWriter() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    thread.join();
+    for (int attempt = 1; !writeQueued(); ++attempt) {
+        if (attempt < SHUTDOWN_ATTEMPTS) {
+            std::this_thread::sleep_for(interval);
+            continue;
+        }
+        std::cerr << "Error writing attendance on shutdown, " << size() << " records were lost" << std::endl;
+        break;
+    }
+}
+
+void AttendanceWriter::push(Record record) {
+    size_t queue_size;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        queued.push_back(record);
+        queue_size = queued.size();
+    }
+    Metrics::global().set(Metrics::Gauge::AttendanceQueueDepth, static_cast<int64_t>(queue_size));
+    if (queue_size >= batch_size) {
+        wake.notify_one();
+    }
+}
+
+bool AttendanceWriter::flush() {
+    return writeQueued();
+}
+
+void AttendanceWriter::discard(int user_id) {
+    discardIf([user_id](const Record& record) { return record.user_id == user_id; });
+}
+
+void AttendanceWriter::discardAll() {
+    discardIf([](const Record&) { return true; });
+}
+
+void AttendanceWriter::discardIf(const std::function<bool(const Record&)>& predicate) {
+    // The write lock waits out a batch in its transaction, its records are in the table afterwards
+    std::lock_guard<std::mutex> write_lock(write_mutex);
+    std::lock_guard<std::mutex> lock(mutex);
+    queued.erase(std::remove_if(queued.begin(), queued.end(), predicate), queued.end());
+    Metrics::global().set(Metrics::Gauge::AttendanceQueueDepth, static_cast<int64_t>(queued.size()));
+}
+
+std::vector<AttendanceWriter::Record> AttendanceWriter::pending() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    std::vector<Record> records(writing.begin(), writing.end());
+    records.insert(records.end(), queued.begin(), queued.end());
+    return records;
+}
+
+size_t AttendanceWriter::size() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return writing.size() + queued.size();
+}
+
+void AttendanceWriter::run() {
+    std::unique_lock<std::mutex> lock(mutex);
+    while (!stopping) {
+        wake.wait_for(lock, interval, [this] { return stopping || queued.size() >= batch_size; });
+        if (stopping || queued.empty()) {
+            continue;
+        }
+        lock.unlock();
+        bool written = writeQueued();
+        lock.lock();
+        if (!written) {
+            // The records are queued again, wait before retrying instead of spinning on a failing disk
+            wake.wait_for(lock, interval, [this] { return stopping; });
+        }
+    }
+}
+
+bool AttendanceWriter::writeQueued() {
+    std::lock_guard<std::mutex> write_lock(write_mutex);
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        writing.assign(queued.begin(), queued.end());
+        queued.clear();
+    }
+    if (writing.empty()) {
+        return true;
+    }
+
+    bool written = false;
+    try {
+        Metrics::Timer timer(Metrics::Stage::RepositoryWrite);
+        write_batch(writing);
+        written = true;
+    }
+    catch (const std::exception& e) {
+        std::cerr << "Error writing " << writing.size() << " attendance records: " << e.what() << std::endl;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!written) {
+        queued.insert(queued.begin(), writing.begin(), writing.end());
+    }
+    writing.clear();
+    Metrics::global().set(Metrics::Gauge::AttendanceQueueDepth, static_cast<int64_t>(queued.size()));
+    return written;
+}
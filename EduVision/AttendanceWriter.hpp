@@ -0,0 +1,70 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <ctime>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Write-behind queue for attendance records. push() never touches the disk:
+// a writer thread hands the queued records to `write_batch` once `batch_size`
+// of them are waiting or `interval` has passed, so one transaction covers
+// many records and a slow disk only grows the queue. A batch that failed to
+// write stays queued and is retried; everything left is written on destruction.
+class AttendanceWriter {
+public:
+    struct Record {
+        int user_id;
+        std::time_t time;
+        std::string camera;
+    };
+
+    // Writes the records in one transaction, throws when they were not written
+    using WriteBatch = std::function<void(const std::vector<Record>&)>;
+
+    AttendanceWriter(WriteBatch write_batch, size_t batch_size = 64,
+        std::chrono::milliseconds interval = std::chrono::milliseconds(1000));
+    ~AttendanceWriter();
+
+    AttendanceWriter(const AttendanceWriter&) = delete;
+    AttendanceWriter& operator=(const AttendanceWriter&) = delete;
+
+    void push(Record record);
+
+    // Writes everything pushed so far before returning, false when that failed
+    bool flush();
+
+    // Drops the queued records of a user once a batch being written is done, so a DELETE of the user's rows
+    // that follows is final. Records pushed afterwards are kept, the caller stops pushing for the user first.
+    void discard(int user_id);
+    // The same for the records of every user
+    void discardAll();
+
+    // Records that are not in the database yet. Taken before reading the table, every record pushed
+    // before is in the snapshot or in what the table returns, possibly in both.
+    [[nodiscard]] std::vector<Record> pending() const;
+    [[nodiscard]] size_t size() const;
+
+private:
+    void run();
+    bool writeQueued();
+    void discardIf(const std::function<bool(const Record&)>& predicate);
+
+    WriteBatch write_batch;
+    const size_t batch_size;
+    const std::chrono::milliseconds interval;
+
+    // Serializes the writer thread and flush()
+    std::mutex write_mutex;
+    mutable std::mutex mutex;
+    std::condition_variable wake;
+    std::deque<Record> queued;
+    std::vector<Record> writing;
+    bool stopping = false;
+    std::thread thread;
+};
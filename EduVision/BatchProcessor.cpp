@@ -0,0 +1,164 @@
+#define _SILENCE_CXX17_CODECVT_HEADER_DEPRECATION_WARNING
+#define _SILENCE_ALL_CXX17_DEPRECATION_WARNINGS
+#define _CRT_SECURE_NO_WARNINGS
+
+#include "BatchProcessor.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <ctime>
+#include <filesystem>
+#include <iomanip>
+#include <mutex>
+#include <sstream>
+#include <thread>
+
+namespace {
+    constexpr double DEFAULT_FPS = 25.0;
+
+    std::chrono::system_clock::duration seconds(double value) {
+        return std::chrono::duration_cast<std::chrono::system_clock::duration>(std::chrono::duration<double>(value));
+    }
+
+    // Offset into a recording as h:mm:ss
+    std::string formatOffset(double offset) {
+        long long total = static_cast<long long>(offset);
+        std::ostringstream out;
+        out << total / 3600 << ':' << std::setfill('0') << std::setw(2) << total / 60 % 60 << ':' << std::setw(2) << total % 60;
+        return out.str();
+    }
+
+    // The recording ends when the file was last written
+    std::chrono::system_clock::time_point modificationTime(const std::string& path) {
+        auto modified = std::filesystem::last_write_time(path);
+        return std::chrono::system_clock::now()
+            + std::chrono::duration_cast<std::chrono::system_clock::duration>(modified - std::filesystem::file_time_type::clock::now());
+    }
+}
+
+BatchProcessor::Recording BatchProcessor::parseRecording(const std::string& argument) {
+    auto separator = argument.rfind('@');
+    if (separator != std::string::npos) {
+        std::tm start{};
+        std::istringstream in(argument.substr(separator + 1));
+        in >> std::get_time(&start, "%Y-%m-%dT%H:%M:%S");
+        if (!in.fail()) {
+            start.tm_isdst = -1;
+            return Recording{ argument.substr(0, separator), std::chrono::system_clock::from_time_t(std::mktime(&start)) };
+        }
+    }
+    return Recording{ argument, std::nullopt };
+}
+
+BatchProcessor::BatchProcessor(FaceRecognizer& recognizer, SharedGallery& gallery, Options options)
+    : recognizer(recognizer), gallery(gallery), options(options) {
+    this->options.frame_stride = std::max<size_t>(this->options.frame_stride, 1);
+}
+
+size_t BatchProcessor::run(const std::vector<Recording>& recordings, std::ostream& log) {
+    size_t failed = 0;
+    double recorded_seconds = 0.0;
+    std::vector<Segment> segments;
+    for (size_t i = 0; i < recordings.size(); ++i) {
+        cv::VideoCapture capture(recordings[i].path);
+        if (!capture.isOpened()) {
+            std::cerr << "Error opening video file " << recordings[i].path << std::endl;
+            ++failed;
+            continue;
+        }
+        double fps = capture.get(cv::CAP_PROP_FPS);
+        if (fps <= 0.0) {
+            fps = DEFAULT_FPS;
+        }
+        const int frame_count = static_cast<int>(capture.get(cv::CAP_PROP_FRAME_COUNT));
+        const double duration = frame_count > 0 ? frame_count / fps : 0.0;
+        recorded_seconds += duration;
+        const auto start = recordings[i].start ? *recordings[i].start : modificationTime(recordings[i].path) - seconds(duration);
+
+        const int segment_frames = static_cast<int>(options.segment_minutes * 60.0 * fps);
+        if (frame_count <= 0 || segment_frames <= 0) {
+            segments.push_back(Segment{ i, start, fps, 0, -1 });
+            continue;
+        }
+        for (int first = 0; first < frame_count; first += segment_frames) {
+            segments.push_back(Segment{ i, start, fps, first, std::min(first + segment_frames, frame_count) });
+        }
+    }
+    if (segments.empty()) {
+        return failed;
+    }
+
+    size_t worker_count = options.workers > 0 ? options.workers : std::max(1u, std::thread::hardware_concurrency());
+    worker_count = std::min(worker_count, segments.size());
+    std::vector<FaceRecognizer::Worker> worker_models;
+    for (size_t i = 0; i < worker_count; ++i) {
+        worker_models.push_back(recognizer.makeWorker());
+    }
+
+    log << "Processing " << recordings.size() - failed << " recordings in " << segments.size() << " segments with "
+        << worker_count << " workers, frame stride " << options.frame_stride << std::endl;
+    const auto started = std::chrono::steady_clock::now();
+    std::atomic<size_t> next_segment{ 0 };
+    std::atomic<size_t> recognized_frames{ 0 };
+    std::mutex log_mutex;
+    std::vector<std::thread> workers;
+    for (auto& worker : worker_models) {
+        workers.emplace_back([&, this] {
+            for (size_t i = next_segment++; i < segments.size(); i = next_segment++) {
+                const Segment& segment = segments[i];
+                const std::string& path = recordings[segment.recording].path;
+                const std::string range = formatOffset(segment.first_frame / segment.fps) + "-"
+                    + (segment.end_frame < 0 ? std::string("end") : formatOffset(segment.end_frame / segment.fps));
+                try {
+                    size_t frames = processSegment(path, segment, worker);
+                    recognized_frames += frames;
+                    std::lock_guard<std::mutex> lock(log_mutex);
+                    log << path << " [" << range << "]: " << frames << " frames" << std::endl;
+                }
+                catch (const std::exception& e) {
+                    std::lock_guard<std::mutex> lock(log_mutex);
+                    std::cerr << "Error processing " << path << " [" << range << "]: " << e.what() << std::endl;
+                }
+            }
+        });
+    }
+    for (std::thread& worker : workers) {
+        worker.join();
+    }
+
+    const double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+    log << "Recognized " << recognized_frames << " frames of " << formatOffset(recorded_seconds) << " of video in "
+        << formatOffset(elapsed) << " (" << std::fixed << std::setprecision(1)
+        << (elapsed > 0.0 ? recorded_seconds / elapsed : 0.0) << "x real time)" << std::endl;
+    return failed;
+}
+
+size_t BatchProcessor::processSegment(const std::string& path, const Segment& segment, FaceRecognizer::Worker& worker) {
+    cv::VideoCapture capture(path);
+    if (!capture.isOpened()) {
+        throw std::runtime_error("Unable to open " + path);
+    }
+    if (segment.first_frame > 0) {
+        capture.set(cv::CAP_PROP_POS_FRAMES, segment.first_frame);
+    }
+
+    FaceTracker face_tracker(recognizer.getTrackerParams());
+    cv::Mat frame;
+    size_t recognized = 0;
+    for (int index = segment.first_frame; segment.end_frame < 0 || index < segment.end_frame; ++index) {
+        // Skipped frames are grabbed but neither converted nor recognized
+        if (static_cast<size_t>(index) % options.frame_stride != 0) {
+            if (!capture.grab()) {
+                break;
+            }
+            continue;
+        }
+        if (!capture.read(frame) || frame.empty()) {
+            break;
+        }
+        recognizer.processFrame(frame, face_tracker, worker, gallery, segment.start + seconds(index / segment.fps), path);
+        ++recognized;
+    }
+    recognizer.finishTracks(face_tracker);
+    return recognized;
+}
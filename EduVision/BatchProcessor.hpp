@@ -0,0 +1,54 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <optional>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "FaceRecognition.hpp"
+#include "SharedGallery.hpp"
+
+// Headless recognition of recorded lectures, without a window or GL context.
+// Recordings are cut into segments that a pool of workers, each with its own
+// network and face detector, processes in parallel; every segment has its own face
+// tracks. Attendance is stored with the time the frame was recorded at.
+class BatchProcessor {
+public:
+    struct Options {
+        size_t frame_stride = 1;        // only every n-th frame is decoded and recognized
+        size_t workers = 0;             // 0 uses every hardware thread
+        double segment_minutes = 10.0;  // length of the pieces a recording is split into, 0 keeps it whole
+    };
+
+    struct Recording {
+        std::string path;
+        // Wall-clock time of the first frame. Unset: the file's modification time minus its duration.
+        std::optional<std::chrono::system_clock::time_point> start;
+    };
+
+    // "path" or "path@YYYY-MM-DDTHH:MM:SS" with the local start time of the recording
+    static Recording parseRecording(const std::string& argument);
+
+    BatchProcessor(FaceRecognizer& recognizer, SharedGallery& gallery, Options options);
+
+    // Processes every recording and returns how many of them could not be read
+    size_t run(const std::vector<Recording>& recordings, std::ostream& log);
+
+private:
+    struct Segment {
+        size_t recording;
+        std::chrono::system_clock::time_point start;  // time of frame 0 of the recording
+        double fps;
+        int first_frame;
+        int end_frame;  // exclusive, -1 runs to the end of the file
+    };
+
+    // Frames of the segment that were recognized
+    size_t processSegment(const std::string& path, const Segment& segment, FaceRecognizer::Worker& worker);
+
+    FaceRecognizer& recognizer;
+    SharedGallery& gallery;
+    Options options;
+};
@@ -0,0 +1,478 @@
+#define _SILENCE_CXX17_CODECVT_HEADER_DEPRECATION_WARNING
+#define _SILENCE_ALL_CXX17_DEPRECATION_WARNINGS
+#define _CRT_SECURE_NO_WARNINGS
+
+#include "Benchmark.hpp"
+#include "DescriptorGallery.hpp"
+#include "FaceRecognition.hpp"
+#include "SharedGallery.hpp"
+#include "User.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <ctime>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <numeric>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+    using Clock = std::chrono::steady_clock;
+
+    constexpr size_t DIMENSIONS = DescriptorGallery::DIMENSIONS;
+    constexpr size_t PHOTOS_PER_PERSON = 4;
+    constexpr float MATCH_THRESHOLD = 0.6f;
+
+    // Identities spread so that different people sit ~0.9 apart and photos of one person
+    // within ~0.4 of each other, roughly what dlib_face_recognition_resnet_model_v1 produces
+    struct SyntheticFaces {
+        std::mt19937 rng{ 7 };
+        std::normal_distribution<float> normal{ 0.0f, 1.0f };
+        std::vector<std::vector<float>> identities;
+
+        std::vector<float> identity() {
+            std::vector<float> center(DIMENSIONS);
+            for (float& value : center) {
+                value = normal(rng) * 0.056f;
+            }
+            identities.push_back(center);
+            return center;
+        }
+
+        std::vector<float> photo(const std::vector<float>& center) {
+            std::vector<float> descriptor(center);
+            for (float& value : descriptor) {
+                value += normal(rng) * 0.025f;
+            }
+            return descriptor;
+        }
+    };
+
+    double elapsedMicroseconds(Clock::time_point begin, Clock::time_point end) {
+        return std::chrono::duration<double, std::micro>(end - begin).count();
+    }
+
+    // `gallery_size` photos of PHOTOS_PER_PERSON each, labelled from `first_label` on
+    void addSyntheticFaces(SyntheticFaces& faces, DescriptorGallery& gallery, size_t gallery_size, int first_label = 0) {
+        gallery.reserve(gallery_size);
+        for (size_t i = 0; i < gallery_size; ++i) {
+            if (i % PHOTOS_PER_PERSON == 0) {
+                faces.identity();
+            }
+            gallery.add(faces.photo(faces.identities.back()).data(), first_label + static_cast<int>(faces.identities.size() - 1));
+        }
+    }
+
+    // New photos of random identities of the gallery
+    std::vector<std::vector<float>> syntheticQueries(SyntheticFaces& faces, size_t query_count) {
+        std::vector<std::vector<float>> queries;
+        queries.reserve(query_count);
+        std::uniform_int_distribution<size_t> pick(0, faces.identities.size() - 1);
+        for (size_t i = 0; i < query_count; ++i) {
+            queries.push_back(faces.photo(faces.identities[pick(faces.rng)]));
+        }
+        return queries;
+    }
+
+    constexpr size_t MIN_ITERATIONS = 3;
+    constexpr size_t MAX_ITERATIONS = 1000000;
+    constexpr size_t MATCH_QUERIES = 1000;
+    constexpr size_t END_TO_END_GALLERY_SIZE = 1000;
+    // Labels of the synthetic end-to-end gallery are no user ids, so a chance match never marks attendance
+    constexpr int SYNTHETIC_FIRST_LABEL = 1 << 24;
+
+    // Keeps the results of the timed calls observable
+    volatile size_t sink = 0;
+
+    struct Measurement {
+        std::string name;
+        size_t iterations = 0;
+        double mean_us = 0.0;
+        double median_us = 0.0;
+        double p99_us = 0.0;
+        double items_per_second = 0.0;
+    };
+
+    // Runs `function` once to warm up, then until `min_seconds` passed, and summarizes the per-run times.
+    // `items` is how many frames/faces/queries one run handles.
+    template <typename Function>
+    Measurement measure(const std::string& name, double min_seconds, size_t items, Function&& function) {
+        std::cerr << "Running " << name << std::endl;
+        function();
+        std::vector<double> times;
+        const auto begin = Clock::now();
+        do {
+            const auto start = Clock::now();
+            function();
+            times.push_back(elapsedMicroseconds(start, Clock::now()));
+        } while (times.size() < MAX_ITERATIONS
+            && (times.size() < MIN_ITERATIONS || elapsedMicroseconds(begin, Clock::now()) < min_seconds * 1e6));
+
+        Measurement measurement;
+        measurement.name = name;
+        measurement.iterations = times.size();
+        const double total_us = std::accumulate(times.begin(), times.end(), 0.0);
+        std::sort(times.begin(), times.end());
+        measurement.mean_us = total_us / times.size();
+        measurement.median_us = times[times.size() / 2];
+        measurement.p99_us = times[std::min(times.size() - 1, times.size() * 99 / 100)];
+        measurement.items_per_second = total_us > 0.0 ? items * times.size() / (total_us / 1e6) : 0.0;
+        return measurement;
+    }
+
+    std::vector<cv::Mat> loadClip(const std::string& clip, size_t max_frames) {
+        std::vector<cv::Mat> frames;
+        cv::VideoCapture capture(clip);
+        cv::Mat frame;
+        while (frames.size() < max_frames && capture.read(frame) && !frame.empty()) {
+            frames.push_back(frame.clone());
+        }
+        if (frames.empty()) {
+            // A single image stands in for a static clip
+            frame = cv::imread(clip);
+            if (frame.empty()) {
+                throw std::runtime_error("Unable to read " + clip);
+            }
+            frames.push_back(frame);
+        }
+        return frames;
+    }
+
+    std::string jsonString(const std::string& value) {
+        std::string quoted = "\"";
+        for (char c : value) {
+            if (c == '"' || c == '\\') {
+                quoted += '\\';
+            }
+            quoted += c;
+        }
+        return quoted + "\"";
+    }
+
+    void writeJson(std::ostream& out, const std::vector<Measurement>& measurements, const PipelineBenchmarkOptions& options, const cv::Mat& frame) {
+        std::time_t now = std::time(nullptr);
+        out << "{\n  \"context\": {\n"
+            << "    \"date\": \"" << std::put_time(std::localtime(&now), "%Y-%m-%dT%H:%M:%S") << "\",\n"
+            << "    \"num_cpus\": " << std::thread::hardware_concurrency() << ",\n"
+            << "    \"clip\": " << jsonString(options.clip) << ",\n"
+            << "    \"frame_width\": " << frame.cols << ",\n"
+            << "    \"frame_height\": " << frame.rows << "\n"
+            << "  },\n  \"benchmarks\": [";
+        for (size_t i = 0; i < measurements.size(); ++i) {
+            const Measurement& m = measurements[i];
+            out << (i == 0 ? "\n" : ",\n")
+                << "    { \"name\": " << jsonString(m.name) << ", \"iterations\": " << m.iterations
+                << ", \"real_time\": " << m.mean_us << ", \"median_time\": " << m.median_us
+                << ", \"p99_time\": " << m.p99_us << ", \"time_unit\": \"us\""
+                << ", \"items_per_second\": " << m.items_per_second << " }";
+        }
+        out << "\n  ]\n}\n";
+    }
+
+    // Faces under this height count as small, the back rows of a lecture hall
+    constexpr int SMALL_FACE_HEIGHT = 60;
+
+    // A detection is of a face when its center lies inside the face's box and the widths are within a factor
+    // of two: the backends frame faces differently, their boxes of one face often overlap too little for IoU
+    bool sameFace(const cv::Rect& detection, const cv::Rect& face) {
+        const cv::Point center(detection.x + detection.width / 2, detection.y + detection.height / 2);
+        return face.contains(center) && detection.width <= face.width * 2 && face.width <= detection.width * 2;
+    }
+
+    // Flags the faces that one of `detections` is of, a detection counting for one face only
+    std::vector<bool> foundFaces(const std::vector<cv::Rect>& faces, const std::vector<cv::Rect>& detections) {
+        std::vector<bool> found(faces.size(), false);
+        std::vector<bool> used(detections.size(), false);
+        for (size_t i = 0; i < faces.size(); ++i) {
+            for (size_t j = 0; j < detections.size() && !found[i]; ++j) {
+                if (!used[j] && sameFace(detections[j], faces[i])) {
+                    found[i] = true;
+                    used[j] = true;
+                }
+            }
+        }
+        return found;
+    }
+
+    // Faces per frame of the clip, from "frame,x,y,width,height" lines with the 0-based frame index
+    std::vector<std::vector<cv::Rect>> readAnnotations(const std::string& path, size_t frame_count) {
+        std::ifstream in(path);
+        if (!in) {
+            throw std::runtime_error("Unable to read " + path);
+        }
+        std::vector<std::vector<cv::Rect>> faces(frame_count);
+        std::string line;
+        while (std::getline(in, line)) {
+            if (line.empty() || line[0] == '#') {
+                continue;
+            }
+            std::istringstream fields(line);
+            size_t frame = 0;
+            cv::Rect face;
+            char separator = 0;
+            if (!(fields >> frame >> separator >> face.x >> separator >> face.y >> separator >> face.width >> separator >> face.height)) {
+                throw std::runtime_error("Malformed annotation in " + path + ": " + line);
+            }
+            if (frame < frame_count) {
+                faces[frame].push_back(face);
+            }
+        }
+        return faces;
+    }
+
+    // Faces that at least two backends found, boxed as the first of them did. `detections` is per backend, then per frame.
+    std::vector<std::vector<cv::Rect>> agreedFaces(const std::vector<std::vector<std::vector<cv::Rect>>>& detections, size_t frame_count) {
+        std::vector<std::vector<cv::Rect>> faces(frame_count);
+        for (size_t frame = 0; frame < frame_count; ++frame) {
+            for (size_t backend = 0; backend < detections.size(); ++backend) {
+                for (const cv::Rect& face : detections[backend][frame]) {
+                    auto same = [&](const cv::Rect& other) { return sameFace(face, other) || sameFace(other, face); };
+                    bool confirmed = false;
+                    for (size_t other = 0; other < detections.size() && !confirmed; ++other) {
+                        confirmed = other != backend && std::any_of(detections[other][frame].begin(), detections[other][frame].end(), same);
+                    }
+                    if (confirmed && std::none_of(faces[frame].begin(), faces[frame].end(), same)) {
+                        faces[frame].push_back(face);
+                    }
+                }
+            }
+        }
+        return faces;
+    }
+
+    void writeCsv(std::ostream& out, const std::vector<Measurement>& measurements) {
+        out << "benchmark,iterations,mean_us,median_us,p99_us,items_per_second\n";
+        for (const Measurement& m : measurements) {
+            out << m.name << "," << m.iterations << "," << m.mean_us << "," << m.median_us << ","
+                << m.p99_us << "," << m.items_per_second << "\n";
+        }
+    }
+}
+
+void benchmarkDescriptorIndex(std::ostream& out, size_t gallery_size, size_t query_count) {
+    SyntheticFaces faces;
+    DescriptorGallery gallery;
+    addSyntheticFaces(faces, gallery, gallery_size);
+    std::vector<std::vector<float>> queries = syntheticQueries(faces, query_count);
+
+    std::vector<DescriptorGallery::Match> exact(query_count);
+    auto begin = Clock::now();
+    for (size_t i = 0; i < query_count; ++i) {
+        exact[i] = gallery.findNearestExact(queries[i].data(), MATCH_THRESHOLD);
+    }
+    double exact_us = elapsedMicroseconds(begin, Clock::now()) / query_count;
+
+    gallery.setExactSearchLimit(0);
+    begin = Clock::now();
+    gallery.buildIndex();
+    double build_s = elapsedMicroseconds(begin, Clock::now()) / 1e6;
+
+    out << "gallery_size,queries,build_seconds,method,ef_search,recall_at_1,label_agreement,us_per_query,speedup\n";
+    out << gallery_size << "," << query_count << ",0,exact,0,1,1," << exact_us << ",1\n";
+    for (size_t ef : { 8, 16, 32, 64, 128, 256 }) {
+        gallery.setEfSearch(ef);
+        std::vector<DescriptorGallery::Match> approximate(query_count);
+        begin = Clock::now();
+        for (size_t i = 0; i < query_count; ++i) {
+            approximate[i] = gallery.findNearest(queries[i].data(), MATCH_THRESHOLD);
+        }
+        double approximate_us = elapsedMicroseconds(begin, Clock::now()) / query_count;
+
+        size_t same_row = 0;
+        size_t same_label = 0;
+        for (size_t i = 0; i < query_count; ++i) {
+            same_row += approximate[i].index == exact[i].index;
+            same_label += approximate[i].label == exact[i].label;
+        }
+        out << gallery_size << "," << query_count << "," << build_s << ",hnsw," << ef << ","
+            << static_cast<double>(same_row) / query_count << ","
+            << static_cast<double>(same_label) / query_count << ","
+            << approximate_us << "," << exact_us / approximate_us << "\n";
+    }
+}
+
+void benchmarkPipeline(std::ostream& out, FaceRecognizer& recognizer, UserRepository& repository, const PipelineBenchmarkOptions& options) {
+    const std::vector<cv::Mat> frames = loadClip(options.clip, options.max_clip_frames);
+    FaceRecognizer::Worker worker = recognizer.makeWorker();
+    std::vector<Measurement> results;
+
+    // The per-face stages run on the first face the detector finds in the clip
+    size_t face_frame = 0;
+    cv::Rect face;
+    for (size_t i = 0; i < frames.size() && face.empty(); ++i) {
+        std::vector<cv::Rect> faces = worker.detector->detect(frames[i]);
+        if (!faces.empty()) {
+            face = faces.front() & cv::Rect(0, 0, frames[i].cols, frames[i].rows);
+            face_frame = i;
+        }
+    }
+    if (face.empty()) {
+        std::cerr << "No face detected in " << options.clip << ", timing the face stages on the center of the first frame" << std::endl;
+        int side = std::min(frames[0].cols, frames[0].rows) / 2;
+        face = cv::Rect((frames[0].cols - side) / 2, (frames[0].rows - side) / 2, side, side);
+    }
+    const cv::Mat& frame = frames[face_frame];
+
+    results.push_back(measure(std::string("detect/") + FaceDetector::backendName(worker.detector->getParams().backend), options.min_seconds, 1, [&] {
+        sink = sink + worker.detector->detect(frame).size();
+    }));
+
+    dlib::shape_predictor sp;
+    dlib::deserialize(FaceRecognizer::SHAPE_PREDICTOR_PATH) >> sp;
+    cv::Mat face_roi = frame(face);
+    dlib::cv_image<dlib::bgr_pixel> cimg(face_roi);
+    const dlib::rectangle face_box(0, 0, face_roi.cols, face_roi.rows);
+    dlib::full_object_detection shape = sp(cimg, face_box);
+    results.push_back(measure("shape_predictor", options.min_seconds, 1, [&] {
+        shape = sp(cimg, face_box);
+    }));
+
+    const dlib::chip_details chip_details = dlib::get_face_chip_details(shape, FaceRecognizer::FACE_CHIP_SIZE, FaceRecognizer::FACE_CHIP_PADDING);
+    dlib::matrix<dlib::rgb_pixel> chip;
+    results.push_back(measure("extract_image_chip", options.min_seconds, 1, [&] {
+        dlib::extract_image_chip(cimg, chip_details, chip);
+    }));
+
+    for (size_t batch_size : { 1, 8, 32 }) {
+        std::vector<dlib::matrix<dlib::rgb_pixel>> chips(batch_size, chip);
+        results.push_back(measure("anet_forward/" + std::to_string(batch_size), options.min_seconds, batch_size, [&] {
+            sink = sink + worker.net(chips, batch_size).size();
+        }));
+    }
+
+    for (size_t gallery_size : { 1000, 10000, 100000 }) {
+        SyntheticFaces faces;
+        DescriptorGallery gallery;
+        addSyntheticFaces(faces, gallery, gallery_size);
+        const std::vector<std::vector<float>> queries = syntheticQueries(faces, MATCH_QUERIES);
+        size_t next_query = 0;
+        results.push_back(measure("match_exact/" + std::to_string(gallery_size), options.min_seconds, 1, [&] {
+            sink = sink + gallery.findNearestExact(queries[next_query++ % queries.size()].data(), MATCH_THRESHOLD).label;
+        }));
+        // As configured for recognition: the index is only searched above the exact search limit
+        gallery.buildIndex();
+        results.push_back(measure("match/" + std::to_string(gallery_size), options.min_seconds, 1, [&] {
+            sink = sink + gallery.findNearest(queries[next_query++ % queries.size()].data(), MATCH_THRESHOLD).label;
+        }));
+    }
+
+    std::vector<User> users = repository.getAll();
+    if (users.empty()) {
+        std::cerr << "No users in the database, skipping the UserRepository benchmarks" << std::endl;
+    }
+    else {
+        User& user = users.front();
+        const int user_id = user.getId();
+        const std::string group = user.getGroup();
+        results.push_back(measure("repository_find_by_id", options.min_seconds, 1, [&] {
+            sink = sink + repository.findById(user_id).has_value();
+        }));
+        results.push_back(measure("repository_find_summary", options.min_seconds, 1, [&] {
+            sink = sink + (repository.findSummary(user_id) != nullptr);
+        }));
+        results.push_back(measure("repository_get_all_by_group", options.min_seconds, 1, [&] {
+            sink = sink + repository.getAllByGroup(group).size();
+        }));
+        // Writes the unchanged user back, to the database the application runs on
+        if (options.repository_writes) {
+            results.push_back(measure("repository_update", options.min_seconds, 1, [&] {
+                repository.update(user);
+            }));
+        }
+    }
+
+    SyntheticFaces faces;
+    DescriptorGallery end_to_end_gallery;
+    addSyntheticFaces(faces, end_to_end_gallery, END_TO_END_GALLERY_SIZE, SYNTHETIC_FIRST_LABEL);
+    SharedGallery gallery(std::move(end_to_end_gallery));
+    results.push_back(measure("end_to_end_fps", options.min_seconds, frames.size(), [&] {
+        FaceTracker face_tracker(recognizer.getTrackerParams());
+        for (const cv::Mat& clip_frame : frames) {
+            recognizer.processFrame(clip_frame, face_tracker, worker, gallery);
+        }
+        recognizer.finishTracks(face_tracker);
+    }));
+
+    if (options.json) {
+        writeJson(out, results, options, frame);
+    }
+    else {
+        writeCsv(out, results);
+    }
+}
+
+void benchmarkDetectors(std::ostream& out, const DetectorBenchmarkOptions& options) {
+    const std::vector<cv::Mat> frames = loadClip(options.clip, options.max_clip_frames);
+
+    std::vector<FaceDetector::Backend> backends;
+    std::vector<Measurement> timings;
+    std::vector<std::vector<std::vector<cv::Rect>>> detections;
+    for (FaceDetector::Backend backend : { FaceDetector::Backend::Haar, FaceDetector::Backend::Hog, FaceDetector::Backend::Dnn }) {
+        FaceDetector::Params params = options.detector;
+        params.backend = backend;
+        std::unique_ptr<FaceDetector> detector;
+        try {
+            detector = FaceDetector::create(params);
+        }
+        catch (const std::exception& e) {
+            std::cerr << "Skipping the " << FaceDetector::backendName(backend) << " detector: " << e.what() << std::endl;
+            continue;
+        }
+        std::vector<std::vector<cv::Rect>> faces;
+        for (const cv::Mat& frame : frames) {
+            faces.push_back(detector->detect(frame));
+        }
+        timings.push_back(measure(std::string("detect/") + FaceDetector::backendName(backend), options.min_seconds, frames.size(), [&] {
+            for (const cv::Mat& frame : frames) {
+                sink = sink + detector->detect(frame).size();
+            }
+        }));
+        backends.push_back(backend);
+        detections.push_back(std::move(faces));
+    }
+    if (backends.empty()) {
+        throw std::runtime_error("No face detector could be created");
+    }
+
+    std::vector<std::vector<cv::Rect>> reference;
+    if (!options.annotations.empty()) {
+        reference = readAnnotations(options.annotations, frames.size());
+    }
+    else {
+        if (backends.size() < 2) {
+            std::cerr << "Only one detector ran and no annotations were given, recall is measured against nothing" << std::endl;
+        }
+        reference = agreedFaces(detections, frames.size());
+    }
+
+    out << "detector,min_face,frames,reference_faces,detections,recall,small_faces,small_recall,ms_per_frame,fps\n";
+    for (size_t i = 0; i < backends.size(); ++i) {
+        size_t reference_faces = 0;
+        size_t found = 0;
+        size_t small_faces = 0;
+        size_t small_found = 0;
+        size_t detection_count = 0;
+        for (size_t frame = 0; frame < frames.size(); ++frame) {
+            const std::vector<bool> frame_found = foundFaces(reference[frame], detections[i][frame]);
+            for (size_t face = 0; face < reference[frame].size(); ++face) {
+                const bool small = reference[frame][face].height < SMALL_FACE_HEIGHT;
+                ++reference_faces;
+                small_faces += small;
+                found += frame_found[face];
+                small_found += small && frame_found[face];
+            }
+            detection_count += detections[i][frame].size();
+        }
+        out << FaceDetector::backendName(backends[i]) << "," << options.detector.min_face_size << "," << frames.size() << ","
+            << reference_faces << "," << detection_count << ","
+            << (reference_faces > 0 ? static_cast<double>(found) / reference_faces : 0.0) << ","
+            << small_faces << "," << (small_faces > 0 ? static_cast<double>(small_found) / small_faces : 0.0) << ","
+            << timings[i].mean_us / frames.size() / 1000.0 << "," << timings[i].items_per_second << "\n";
+    }
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <cstddef>
+#include <ostream>
+#include <string>
+
+#include "FaceDetector.hpp"
+
+class FaceRecognizer;
+class UserRepository;
+
+// Recall and per-query latency of the HNSW index against the exact linear scan
+// for a synthetic gallery of `gallery_size` descriptors, one row per ef_search value.
+void benchmarkDescriptorIndex(std::ostream& out, size_t gallery_size, size_t query_count = 1000);
+
+struct PipelineBenchmarkOptions {
+    std::string clip;              // video file or image the stages and the end-to-end run are timed on
+    bool json = false;             // Google Benchmark style JSON instead of CSV
+    double min_seconds = 0.5;      // measuring time of every benchmark, after one warm-up run
+    size_t max_clip_frames = 300;  // frames of the clip held in memory for the end-to-end run
+    bool repository_writes = false;  // also time UserRepository::update, which writes to local.db
+};
+
+// Times every stage of the recognition pipeline on fixed inputs: face detection, the shape predictor,
+// chip extraction, the ResNet at batch 1/8/32, matching against synthetic galleries of 1k/10k/100k
+// descriptors, the UserRepository reads (and the cached findSummary), its writes when asked for, and frames per second of
+// processFrame over the clip.
+// One row (or JSON object) per benchmark with mean, median and 99th percentile time.
+void benchmarkPipeline(std::ostream& out, FaceRecognizer& recognizer, UserRepository& repository, const PipelineBenchmarkOptions& options);
+
+struct DetectorBenchmarkOptions {
+    std::string clip;               // video file or image the detectors run on
+    std::string annotations;        // "frame,x,y,width,height" per face; empty compares with the faces two backends agree on
+    FaceDetector::Params detector;  // minimum face size, pyramid step and models every backend runs with
+    double min_seconds = 0.5;       // measuring time of every backend, after one warm-up pass over the clip
+    size_t max_clip_frames = 300;   // frames of the clip held in memory
+};
+
+// Every face detector backend over the same clip: frames per second, and recall against the annotated
+// faces, overall and for small faces. One CSV row per backend; a backend whose model is missing is skipped.
+void benchmarkDetectors(std::ostream& out, const DetectorBenchmarkOptions& options);
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <mutex>
+#include <optional>
+
+// Multi-producer/multi-consumer FIFO with a fixed capacity. push() blocks while
+// the queue is full, which is what bounds the memory of a pipeline stage.
+template <typename T>
+class BoundedQueue {
+public:
+    explicit BoundedQueue(size_t capacity) : capacity(capacity > 0 ? capacity : 1) {}
+
+    // Returns false when the queue was closed and the item was not queued
+    bool push(T item) {
+        std::unique_lock<std::mutex> lock(mutex);
+        not_full.wait(lock, [this] { return closed || items.size() < capacity; });
+        if (closed) {
+            return false;
+        }
+        items.push_back(std::move(item));
+        not_empty.notify_one();
+        return true;
+    }
+
+    // Waits for an item, empty once the queue is closed and drained
+    std::optional<T> pop() {
+        std::unique_lock<std::mutex> lock(mutex);
+        not_empty.wait(lock, [this] { return closed || !items.empty(); });
+        if (items.empty()) {
+            return std::nullopt;
+        }
+        T item = std::move(items.front());
+        items.pop_front();
+        not_full.notify_one();
+        return item;
+    }
+
+    // Producers are done: pending items can still be popped, further pushes fail
+    void close() {
+        std::lock_guard<std::mutex> lock(mutex);
+        closed = true;
+        not_empty.notify_all();
+        not_full.notify_all();
+    }
+
+    [[nodiscard]] size_t size() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return items.size();
+    }
+
+    [[nodiscard]] size_t getCapacity() const { return capacity; }
+
+private:
+    const size_t capacity;
+    mutable std::mutex mutex;
+    std::condition_variable not_empty;
+    std::condition_variable not_full;
+    std::deque<T> items;
+    bool closed = false;
+};
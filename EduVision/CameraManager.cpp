@@ -0,0 +1,252 @@
+#define _SILENCE_CXX17_CODECVT_HEADER_DEPRECATION_WARNING
+#define _SILENCE_ALL_CXX17_DEPRECATION_WARNINGS
+#define _CRT_SECURE_NO_WARNINGS
+
+#include "CameraManager.hpp"
+#include "Metrics.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <iostream>
+
+namespace {
+    bool isDeviceIndex(const std::string& uri) {
+        return !uri.empty() && std::all_of(uri.begin(), uri.end(), [](unsigned char c) { return std::isdigit(c) != 0; });
+    }
+}
+
+CameraManager::Source CameraManager::parseSource(const std::string& argument) {
+    auto separator = argument.find('=');
+    if (separator == std::string::npos || argument.find("://") < separator) {
+        return Source{ argument, argument };
+    }
+    return Source{ argument.substr(0, separator), argument.substr(separator + 1) };
+}
+
+CameraManager::CameraManager(FaceRecognizer& recognizer, SharedGallery& gallery, std::vector<Source> sources, size_t workers,
+    RecognitionScheduler::Params scheduling, double cpu_budget)
+    : recognizer(recognizer), gallery(gallery) {
+    if (sources.empty()) {
+        throw std::invalid_argument("At least one camera source is required");
+    }
+    if (cpu_budget > 0.0) {
+        scheduling.cpu_cores = cpu_budget * std::max(1u, std::thread::hardware_concurrency()) / sources.size();
+    }
+    for (Source& source : sources) {
+        auto camera = std::make_unique<Camera>();
+        camera->source = std::move(source);
+        camera->tracker = FaceTracker(recognizer.getTrackerParams());
+        FaceDetector::Params detection = recognizer.getDetectorParams();
+        if (!camera->source.detector.empty()) {
+            detection.backend = FaceDetector::parseBackend(camera->source.detector);
+        }
+        camera->detector = FaceDetector::create(detection);
+        camera->scheduler = RecognitionScheduler(scheduling);
+        if (isDeviceIndex(camera->source.uri)) {
+            camera->capture.open(std::stoi(camera->source.uri), cv::CAP_DSHOW);
+        }
+        else {
+            camera->capture.open(camera->source.uri);
+            camera->is_file = camera->source.uri.find("://") == std::string::npos;
+        }
+        if (!camera->capture.isOpened()) {
+            throw std::runtime_error("Error opening video stream " + camera->source.uri);
+        }
+        cameras.push_back(std::move(camera));
+    }
+
+    // Every worker has its own copy of the network, faces are detected with the camera's detector
+    const size_t worker_count = workers > 0 ? workers : cameras.size();
+    for (size_t i = 0; i < worker_count; ++i) {
+        worker_models.push_back(recognizer.makeWorker());
+    }
+}
+
+CameraManager::~CameraManager() {
+    stop();
+}
+
+void CameraManager::start() {
+    stop_flag = false;
+    for (auto& camera : cameras) {
+        camera->thread = std::thread(&CameraManager::captureLoop, this, std::ref(*camera));
+    }
+    for (auto& worker : worker_models) {
+        workers.emplace_back(&CameraManager::workerLoop, this, std::ref(worker));
+    }
+}
+
+void CameraManager::stop() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stop_flag = true;
+    }
+    frame_ready.notify_all();
+    for (auto& camera : cameras) {
+        if (camera->thread.joinable()) {
+            camera->thread.join();
+        }
+    }
+    for (std::thread& worker : workers) {
+        if (worker.joinable()) {
+            worker.join();
+        }
+    }
+    workers.clear();
+}
+
+void CameraManager::captureLoop(Camera& camera) {
+    // Files are played back at their own frame rate so they stand in for live cameras
+    const double fps = camera.is_file ? camera.capture.get(cv::CAP_PROP_FPS) : 0.0;
+    const auto frame_interval = std::chrono::duration<double>(fps > 0.0 ? 1.0 / fps : 0.0);
+    auto next_frame = std::chrono::steady_clock::now();
+
+    auto window_start = std::chrono::steady_clock::now();
+    uint64_t window_grabbed = 0;
+    uint64_t window_decoded = 0;
+
+    while (!stop_flag) {
+        // Grabbing keeps the source's own buffer drained, decoding is what costs
+        if (!camera.capture.grab()) {
+            break;
+        }
+        const auto grabbed_at = std::chrono::system_clock::now();
+        ++camera.grabbed;
+        ++window_grabbed;
+        Metrics::global().add(Metrics::Counter::FramesCaptured);
+
+        // A frame is only decoded when the one before it was taken, otherwise it would most likely be replaced unseen.
+        // Decoding goes into a reused slot, so the frame's buffer is only allocated once.
+        Frame* frame = camera.frames.latestSequence() <= camera.consumed ? camera.frames.beginWrite() : nullptr;
+        if (frame == nullptr) {
+            // Not decoded: the previous frame is still unseen or every free slot is being read
+            Metrics::global().add(Metrics::Counter::FramesDropped);
+        }
+        else {
+            if (!camera.capture.retrieve(frame->image) || frame->image.empty()) {
+                break;
+            }
+            frame->timestamp = grabbed_at;
+            camera.frames.commitWrite();
+            ++camera.decoded;
+            ++window_decoded;
+            {
+                // Workers check for new frames under the mutex, so this orders the notification after their check
+                std::lock_guard<std::mutex> lock(mutex);
+            }
+            frame_ready.notify_one();
+        }
+
+        const auto now = std::chrono::steady_clock::now();
+        const double window = std::chrono::duration<double>(now - window_start).count();
+        if (window >= 1.0) {
+            camera.grab_fps = window_grabbed / window;
+            camera.decode_fps = window_decoded / window;
+            window_start = now;
+            window_grabbed = 0;
+            window_decoded = 0;
+        }
+
+        if (fps > 0.0) {
+            next_frame += std::chrono::duration_cast<std::chrono::steady_clock::duration>(frame_interval);
+            std::this_thread::sleep_until(next_frame);
+        }
+    }
+
+    camera.capture.release();
+    camera.finished = true;
+}
+
+CameraManager::Camera* CameraManager::nextReady() {
+    Camera* ready = nullptr;
+    int64_t pending = 0;
+    for (size_t i = 0; i < cameras.size(); ++i) {
+        Camera& camera = *cameras[(next_camera + i) % cameras.size()];
+        if (!camera.busy && camera.frames.latestSequence() > camera.processed) {
+            ++pending;
+            if (ready == nullptr) {
+                ready = &camera;
+                next_camera = (next_camera + i + 1) % cameras.size();
+            }
+        }
+    }
+    Metrics::global().set(Metrics::Gauge::FramesPending, ready != nullptr ? pending - 1 : 0);
+    return ready;
+}
+
+void CameraManager::workerLoop(FaceRecognizer::Worker& worker) {
+    while (true) {
+        Camera* camera = nullptr;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            frame_ready.wait(lock, [&] { return stop_flag || (camera = nextReady()) != nullptr; });
+            if (stop_flag) {
+                break;
+            }
+            camera->busy = true;
+        }
+        Metrics::global().add(Metrics::Gauge::WorkersBusy, 1);
+
+        uint64_t sequence = 0;
+        {
+            FrameBuffer<Frame>::Lease frame = takeFrame(*camera);
+            sequence = frame.sequence();
+            try {
+                std::vector<cv::Rect> tracked;
+                for (const FaceTracker::Track& track : camera->tracker.getTracks()) {
+                    tracked.push_back(track.box);
+                }
+                RecognitionScheduler::Decision decision = camera->scheduler.evaluate(frame->image, tracked);
+                if (decision.process) {
+                    const auto started = std::chrono::steady_clock::now();
+                    recognizer.processFrame(frame->image, camera->tracker, worker, gallery, frame->timestamp, camera->source.name,
+                        decision.regions, camera->detector.get());
+                    camera->scheduler.finished(std::chrono::steady_clock::now() - started);
+                }
+                else {
+                    Metrics::global().add(Metrics::Counter::FramesSkipped);
+                }
+            }
+            catch (const std::exception& e) {
+                std::cerr << "Error recognizing faces on " << camera->source.name << ": " << e.what() << std::endl;
+            }
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            // Frames published between the last two the worker took were never recognized
+            if (sequence > camera->processed + 1) {
+                Metrics::global().add(Metrics::Counter::FramesDropped, sequence - camera->processed - 1);
+            }
+            camera->processed = sequence;
+            camera->busy = false;
+        }
+        Metrics::global().add(Metrics::Gauge::WorkersBusy, -1);
+        // The camera may have a newer frame waiting that no other worker could take
+        frame_ready.notify_one();
+    }
+}
+
+FrameBuffer<CameraManager::Frame>::Lease CameraManager::takeFrame(Camera& camera) {
+    FrameBuffer<Frame>::Lease frame = camera.frames.acquire();
+    // Keeps the highest sequence when the UI and a worker take frames at the same time
+    uint64_t consumed = camera.consumed.load();
+    while (frame && consumed < frame.sequence() && !camera.consumed.compare_exchange_weak(consumed, frame.sequence())) {
+        // `consumed` now holds the current value
+    }
+    return frame;
+}
+
+FrameBuffer<CameraManager::Frame>::Lease CameraManager::latestFrame(size_t camera) const {
+    return takeFrame(*cameras[camera]);
+}
+
+CameraManager::CaptureStats CameraManager::getCaptureStats(size_t camera) const {
+    const Camera& source = *cameras[camera];
+    return CaptureStats{ source.grab_fps.load(), source.decode_fps.load(), source.grabbed.load(), source.decoded.load() };
+}
+
+bool CameraManager::isCapturing() const {
+    return std::any_of(cameras.begin(), cameras.end(), [](const auto& camera) { return !camera->finished; });
+}
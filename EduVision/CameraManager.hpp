@@ -0,0 +1,116 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <opencv2/opencv.hpp>
+
+#include "FaceDetector.hpp"
+#include "FaceRecognition.hpp"
+#include "FaceTracker.hpp"
+#include "FrameBuffer.hpp"
+#include "RecognitionScheduler.hpp"
+#include "SharedGallery.hpp"
+
+// Captures N cameras, each on its own thread, and feeds their frames to a shared
+// pool of recognition workers. A worker always takes the next camera in
+// round-robin order that has a new frame, and a camera is processed by one
+// worker at a time so its face tracks see the frames in order. A camera that
+// produces frames faster than they are recognized only loses its stale frames.
+// Frames are decoded into preallocated per-camera slots and handed to the
+// worker and the UI without locking or copying. Capture grabs every frame
+// but only decodes one once the previous frame was taken by a consumer, so
+// frames nobody would look at are never decoded.
+class CameraManager {
+public:
+    struct Frame {
+        cv::Mat image;
+        std::chrono::system_clock::time_point timestamp;  // when the frame was grabbed
+    };
+
+    struct CaptureStats {
+        double grab_fps = 0.0;    // frames read from the source per second, over the last second
+        double decode_fps = 0.0;  // of those, decoded and published
+        uint64_t grabbed = 0;
+        uint64_t decoded = 0;
+    };
+
+    struct Source {
+        std::string name;
+        // Device index ("0"), video file, or stream URL such as rtsp://host/stream
+        std::string uri;
+        // Face detector backend of this camera ("haar", "hog" or "dnn"), empty for the recognizer's
+        std::string detector;
+    };
+
+    // "name=uri" or a bare uri, which is then also the name
+    static Source parseSource(const std::string& argument);
+
+    // `workers` 0 starts one recognition worker per camera. `cpu_budget` is the fraction of all hardware
+    // threads recognition may keep busy, split evenly between the cameras; 0 sets no limit.
+    CameraManager(FaceRecognizer& recognizer, SharedGallery& gallery, std::vector<Source> sources, size_t workers = 0,
+        RecognitionScheduler::Params scheduling = {}, double cpu_budget = 0.0);
+    ~CameraManager();
+
+    CameraManager(const CameraManager&) = delete;
+    CameraManager& operator=(const CameraManager&) = delete;
+
+    void start();
+    void stop();
+
+    [[nodiscard]] size_t getCameraCount() const { return cameras.size(); }
+    [[nodiscard]] const std::string& getCameraName(size_t camera) const { return cameras[camera]->source.name; }
+    // Latest captured frame of a camera, empty while there is none. Hold the lease only as long as the
+    // frame is read: the slot is not reused for capture until it is released.
+    FrameBuffer<Frame>::Lease latestFrame(size_t camera) const;
+    [[nodiscard]] CaptureStats getCaptureStats(size_t camera) const;
+    // False once every source has ended (end of file or lost stream)
+    [[nodiscard]] bool isCapturing() const;
+
+private:
+    struct Camera {
+        Source source;
+        cv::VideoCapture capture;
+        bool is_file = false;
+        std::thread thread;
+        FaceTracker tracker;
+        std::unique_ptr<FaceDetector> detector;
+        RecognitionScheduler scheduler;
+        // Read by at most one recognition worker and the UI at a time
+        FrameBuffer<Frame> frames{ 2 };
+        // Newest sequence a worker or the UI has taken; a frame is decoded only when the previous one was
+        std::atomic<uint64_t> consumed{ 0 };
+        std::atomic<bool> finished{ false };
+        // Written by the capture thread
+        std::atomic<uint64_t> grabbed{ 0 };
+        std::atomic<uint64_t> decoded{ 0 };
+        std::atomic<double> grab_fps{ 0.0 };
+        std::atomic<double> decode_fps{ 0.0 };
+        // Guarded by CameraManager::mutex
+        uint64_t processed = 0;
+        bool busy = false;
+    };
+
+    void captureLoop(Camera& camera);
+    // Takes the camera's latest frame and records that it was consumed
+    static FrameBuffer<Frame>::Lease takeFrame(Camera& camera);
+    void workerLoop(FaceRecognizer::Worker& worker);
+    // Next camera with an unprocessed frame and no worker on it, round-robin; nullptr when there is none
+    Camera* nextReady();
+
+    FaceRecognizer& recognizer;
+    SharedGallery& gallery;
+    std::vector<std::unique_ptr<Camera>> cameras;
+    std::vector<FaceRecognizer::Worker> worker_models;
+    std::vector<std::thread> workers;
+    mutable std::mutex mutex;
+    std::condition_variable frame_ready;
+    size_t next_camera = 0;
+    std::atomic<bool> stop_flag{ false };
+};
@@ -0,0 +1,44 @@
+#pragma once
+
+// Compile-time and run-time detection of the x86 vector extensions used by the
+// descriptor matching kernels. The baseline build only assumes SSE2, AVX2 code
+// paths are compiled with a per-function target and picked at run time so the
+// same binary runs on the Atom/Celeron classroom boxes.
+
+#if defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2) || defined(__SSE2__)
+#define EDUVISION_HAS_SSE2 1
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#endif
+
+#if defined(EDUVISION_HAS_SSE2) && !defined(_MSC_VER)
+#define EDUVISION_TARGET_AVX2 __attribute__((target("avx2,fma,f16c")))
+#else
+#define EDUVISION_TARGET_AVX2
+#endif
+
+// True when the CPU and the OS both support AVX2 together with FMA and F16C
+inline bool cpuSupportsAvx2() {
+#if defined(EDUVISION_HAS_SSE2) && defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 0);
+    if (info[0] < 7) {
+        return false;
+    }
+    __cpuid(info, 1);
+    const bool osxsave = (info[2] & (1 << 27)) != 0;
+    const bool fma = (info[2] & (1 << 12)) != 0;
+    const bool f16c = (info[2] & (1 << 29)) != 0;
+    if (!osxsave || !fma || !f16c || (_xgetbv(0) & 6) != 6) {
+        return false;
+    }
+    __cpuidex(info, 7, 0);
+    return (info[1] & (1 << 5)) != 0;
+#elif defined(EDUVISION_HAS_SSE2)
+    return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma") && __builtin_cpu_supports("f16c");
+#else
+    return false;
+#endif
+}
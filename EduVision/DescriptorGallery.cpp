@@ -0,0 +1,473 @@
+#define _SILENCE_CXX17_CODECVT_HEADER_DEPRECATION_WARNING
+#define _SILENCE_ALL_CXX17_DEPRECATION_WARNINGS
+#define _CRT_SECURE_NO_WARNINGS
+
+#include "DescriptorGallery.hpp"
+#include "DescriptorKernels.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <stdexcept>
+
+namespace {
+    constexpr size_t DIMENSIONS = DescriptorGallery::DIMENSIONS;
+
+    // Gallery rows multiplied at once in the batched path, bounds the dot product scratch to
+    // queries x GEMM_BLOCK_ROWS floats whatever the enrollment size is
+    constexpr size_t GEMM_BLOCK_ROWS = 4096;
+
+    // 8-bit range used when the gallery is still empty, dlib descriptor components stay well inside it
+    constexpr float DEFAULT_CODE_RANGE = 0.5f;
+
+    // Share of the observed span added on either side of the 8-bit range, so later enrollments
+    // rarely fall outside of it and force a re-encode
+    constexpr float CODE_RANGE_MARGIN = 0.1f;
+
+    uint8_t encodeComponent(float value, float offset, float scale) {
+        return static_cast<uint8_t>(std::clamp(std::round((value - offset) / scale), 0.0f, 255.0f));
+    }
+}
+
+DescriptorGallery::DescriptorGallery(const std::vector<dlib::matrix<float, 0, 1>>& descriptors, const std::vector<int>& labels) {
+    if (descriptors.size() != labels.size()) {
+        throw std::invalid_argument("Descriptor and label counts differ");
+    }
+    reserve(descriptors.size());
+    for (size_t i = 0; i < descriptors.size(); ++i) {
+        add(descriptors[i], labels[i]);
+    }
+}
+
+void DescriptorGallery::reserve(size_t count) {
+    detachMapping();
+    if (float_rows) {
+        data.reserve(count * DIMENSIONS);
+    }
+    if (storage_mode == StorageMode::Int8) {
+        codes.reserve(count * DIMENSIONS);
+    }
+    else if (storage_mode == StorageMode::Float16) {
+        halves.reserve(count * DIMENSIONS);
+    }
+    squared_norms.reserve(count);
+    labels.reserve(count);
+}
+
+void DescriptorGallery::add(const dlib::matrix<float, 0, 1>& descriptor, int label) {
+    if (descriptor.size() != static_cast<long>(DIMENSIONS)) {
+        throw std::invalid_argument("Face descriptor must have 128 components");
+    }
+    add(&descriptor(0), label);
+}
+
+void DescriptorGallery::add(const float* descriptor, int label) {
+    detachMapping();
+    if (float_rows) {
+        data.insert(data.end(), descriptor, descriptor + DIMENSIONS);
+    }
+    if (storage_mode != StorageMode::Float32) {
+        quantizeRow(descriptor);
+    }
+    float norm = 0.0f;
+    for (size_t i = 0; i < DIMENSIONS; ++i) {
+        norm += descriptor[i] * descriptor[i];
+    }
+    squared_norms.push_back(norm);
+    labels.push_back(label);
+    content_fingerprint = extendFingerprint(content_fingerprint, descriptor, label);
+    if (index) {
+        index->insert(*this, size() - 1);
+    }
+}
+
+void DescriptorGallery::assignMapped(std::shared_ptr<const void> owner, const float* rows, const float* row_squared_norms, const int* row_labels, size_t count, uint64_t fingerprint) {
+    if (!float_rows) {
+        throw std::logic_error("The float rows of the gallery were already released");
+    }
+    data.clear();
+    squared_norms.clear();
+    labels.clear();
+    mapping = std::move(owner);
+    mapped_rows = rows;
+    mapped_norms = row_squared_norms;
+    mapped_labels = row_labels;
+    mapped_count = count;
+    removed_labels.clear();
+    content_fingerprint = fingerprint;
+    codes.clear();
+    halves.clear();
+    if (storage_mode != StorageMode::Float32) {
+        for (size_t j = 0; j < count; ++j) {
+            quantizeRow(descriptor(j));
+        }
+    }
+    if (index) {
+        index->build(*this);
+    }
+}
+
+void DescriptorGallery::detachMapping() {
+    if (!mapping) {
+        return;
+    }
+    if (float_rows) {
+        data.assign(mapped_rows, mapped_rows + mapped_count * DIMENSIONS);
+    }
+    squared_norms.assign(mapped_norms, mapped_norms + mapped_count);
+    labels.assign(mapped_labels, mapped_labels + mapped_count);
+    mapping.reset();
+    mapped_rows = nullptr;
+    mapped_norms = nullptr;
+    mapped_labels = nullptr;
+    mapped_count = 0;
+}
+
+void DescriptorGallery::clear() {
+    mapping.reset();
+    mapped_count = 0;
+    data.clear();
+    codes.clear();
+    halves.clear();
+    squared_norms.clear();
+    labels.clear();
+    removed_labels.clear();
+    content_fingerprint = EMPTY_FINGERPRINT;
+    if (index) {
+        index->build(*this);
+    }
+}
+
+uint64_t DescriptorGallery::extendFingerprint(uint64_t fingerprint, const float* descriptor, int label) {
+    auto mix = [&fingerprint](const void* bytes, size_t length) {
+        const unsigned char* p = static_cast<const unsigned char*>(bytes);
+        for (size_t i = 0; i < length; ++i) {
+            fingerprint = (fingerprint ^ p[i]) * 1099511628211ull;
+        }
+    };
+    mix(descriptor, DIMENSIONS * sizeof(float));
+    mix(&label, sizeof(label));
+    return fingerprint;
+}
+
+void DescriptorGallery::buildIndex(const HnswIndex::Params& params) {
+    index.emplace(params);
+    index->build(*this);
+}
+
+void DescriptorGallery::prepareIndex(const std::string& path, const HnswIndex::Params& params) {
+    if (size() < exact_search_limit) {
+        index.reset();
+        return;
+    }
+    index.emplace(params);
+    if (index->load(path, fingerprint())) {
+        index->setEfSearch(params.ef_search);
+        return;
+    }
+    index->build(*this);
+    try {
+        index->save(path, fingerprint());
+    }
+    catch (const std::exception& e) {
+        std::cerr << "Error saving " << path << ": " << e.what() << std::endl;
+    }
+}
+
+void DescriptorGallery::saveIndex(const std::string& path) const {
+    if (index) {
+        index->save(path, fingerprint());
+    }
+}
+
+void DescriptorGallery::setEfSearch(size_t ef) {
+    if (index) {
+        index->setEfSearch(ef);
+    }
+}
+
+void DescriptorGallery::setStorageMode(StorageMode mode, size_t rerank_top_k) {
+    if (!float_rows) {
+        throw std::logic_error("The float rows of the gallery were already released");
+    }
+    storage_mode = mode;
+    this->rerank_top_k = rerank_top_k;
+    codes.clear();
+    halves.clear();
+    code_offsets.clear();
+    code_scales.clear();
+
+    if (mode == StorageMode::Int8) {
+        code_offsets.assign(DIMENSIONS, -DEFAULT_CODE_RANGE);
+        code_scales.assign(DIMENSIONS, 2.0f * DEFAULT_CODE_RANGE / 255.0f);
+        if (!empty()) {
+            std::vector<float> low(descriptor(0), descriptor(0) + DIMENSIONS);
+            std::vector<float> high(low);
+            for (size_t j = 1; j < size(); ++j) {
+                const float* row = descriptor(j);
+                for (size_t d = 0; d < DIMENSIONS; ++d) {
+                    low[d] = std::min(low[d], row[d]);
+                    high[d] = std::max(high[d], row[d]);
+                }
+            }
+            for (size_t d = 0; d < DIMENSIONS; ++d) {
+                const float margin = CODE_RANGE_MARGIN * (high[d] - low[d]);
+                code_offsets[d] = low[d] - margin;
+                code_scales[d] = std::max(high[d] - low[d] + 2.0f * margin, 1e-6f) / 255.0f;
+            }
+        }
+        codes.reserve(size() * DIMENSIONS);
+    }
+    else if (mode == StorageMode::Float16) {
+        halves.reserve(size() * DIMENSIONS);
+    }
+    if (mode != StorageMode::Float32) {
+        for (size_t j = 0; j < size(); ++j) {
+            quantizeRow(descriptor(j));
+        }
+    }
+
+    if (mode != StorageMode::Float32 && rerank_top_k == 0) {
+        // Norms and labels still come along when the rows were mapped, the rows themselves are dropped
+        float_rows = false;
+        detachMapping();
+        data.clear();
+        data.shrink_to_fit();
+    }
+}
+
+void DescriptorGallery::quantizeRow(const float* descriptor) {
+    if (storage_mode == StorageMode::Int8) {
+        widenCodeRange(descriptor);
+        for (size_t d = 0; d < DIMENSIONS; ++d) {
+            codes.push_back(encodeComponent(descriptor[d], code_offsets[d], code_scales[d]));
+        }
+    }
+    else if (storage_mode == StorageMode::Float16) {
+        for (size_t d = 0; d < DIMENSIONS; ++d) {
+            halves.push_back(floatToHalf(descriptor[d]));
+        }
+    }
+}
+
+void DescriptorGallery::widenCodeRange(const float* row) {
+    const size_t count = codes.size() / DIMENSIONS;
+    for (size_t d = 0; d < DIMENSIONS; ++d) {
+        const float low = code_offsets[d];
+        const float high = low + 255.0f * code_scales[d];
+        if (row[d] >= low && row[d] <= high) {
+            continue;
+        }
+        const float margin = CODE_RANGE_MARGIN * (std::max(high, row[d]) - std::min(low, row[d]));
+        const float new_low = row[d] < low ? row[d] - margin : low;
+        const float new_high = row[d] > high ? row[d] + margin : high;
+        const float new_scale = (new_high - new_low) / 255.0f;
+        for (size_t j = 0; j < count; ++j) {
+            uint8_t& code = codes[j * DIMENSIONS + d];
+            const float value = float_rows ? descriptor(j)[d] : low + code_scales[d] * code;
+            code = encodeComponent(value, new_low, new_scale);
+        }
+        code_offsets[d] = new_low;
+        code_scales[d] = new_scale;
+    }
+}
+
+const float* DescriptorGallery::prepareQuery(const float* query, float* buffer) const {
+    if (storage_mode != StorageMode::Int8) {
+        return query;
+    }
+    for (size_t d = 0; d < DIMENSIONS; ++d) {
+        buffer[d] = query[d] - code_offsets[d];
+    }
+    return buffer;
+}
+
+const float* DescriptorGallery::rowQuery(size_t index, float* buffer) const {
+    if (storage_mode == StorageMode::Int8) {
+        // Decoded and shifted by the offsets in one step
+        const uint8_t* row = codes.data() + index * DIMENSIONS;
+        for (size_t d = 0; d < DIMENSIONS; ++d) {
+            buffer[d] = code_scales[d] * row[d];
+        }
+        return buffer;
+    }
+    if (storage_mode == StorageMode::Float16) {
+        const uint16_t* row = halves.data() + index * DIMENSIONS;
+        for (size_t d = 0; d < DIMENSIONS; ++d) {
+            buffer[d] = halfToFloat(row[d]);
+        }
+        return buffer;
+    }
+    return descriptor(index);
+}
+
+float DescriptorGallery::rowDistance(const float* prepared_query, size_t index) const {
+    if (storage_mode == StorageMode::Int8) {
+        return squaredDistanceU8(prepared_query, codes.data() + index * DIMENSIONS, code_scales.data());
+    }
+    if (storage_mode == StorageMode::Float16) {
+        return squaredDistanceF16(prepared_query, halves.data() + index * DIMENSIONS);
+    }
+    return squaredDistanceF32(prepared_query, descriptor(index));
+}
+
+size_t DescriptorGallery::memoryBytes() const {
+    return data.size() * sizeof(float) + codes.size() * sizeof(uint8_t) + halves.size() * sizeof(uint16_t)
+        + squared_norms.size() * sizeof(float) + labels.size() * sizeof(int);
+}
+
+float DescriptorGallery::squaredDistance(const float* a, const float* b) {
+    return squaredDistanceF32(a, b);
+}
+
+DescriptorGallery::Match DescriptorGallery::findNearest(const float* query, float max_distance) const {
+    if (!usesIndex()) {
+        if (storage_mode != StorageMode::Float32) {
+            return findNearestQuantized(query, max_distance);
+        }
+        return findNearestExact(query, max_distance);
+    }
+    // The graph ranks by rowDistance, over the quantized rows when there are any, and returns live rows only;
+    // with re-ranking the best rerank_top_k candidates are compared again in fp32, otherwise the first one decides
+    const bool rerank = storage_mode != StorageMode::Float32 && rerank_top_k > 0 && float_rows;
+    Match match;
+    float best = max_distance * max_distance;
+    for (const auto& [row, distance] : index->search(*this, query, rerank ? rerank_top_k : 1)) {
+        float exact = rerank ? squaredDistanceF32(query, descriptor(row)) : distance;
+        if (exact < best) {
+            best = exact;
+            match.index = row;
+        }
+        if (!rerank) {
+            break;
+        }
+    }
+    if (match.index != static_cast<size_t>(-1)) {
+        match.label = label(match.index);
+        match.distance = std::sqrt(best);
+    }
+    return match;
+}
+
+DescriptorGallery::Match DescriptorGallery::findNearestExact(const float* query, float max_distance) const {
+    if (!float_rows) {
+        return findNearestQuantized(query, max_distance);
+    }
+    Match match;
+    float best = max_distance * max_distance;
+    const size_t count = size();
+    for (size_t j = 0; j < count; ++j) {
+        float distance = squaredDistanceF32(query, descriptor(j));
+        if (distance < best && !isRemoved(j)) {
+            best = distance;
+            match.index = j;
+        }
+    }
+    if (match.index != static_cast<size_t>(-1)) {
+        match.label = label(match.index);
+        match.distance = std::sqrt(best);
+    }
+    return match;
+}
+
+DescriptorGallery::Match DescriptorGallery::findNearestQuantized(const float* query, float max_distance) const {
+    alignas(32) float buffer[DIMENSIONS];
+    const float* prepared_query = prepareQuery(query, buffer);
+
+    // Without re-ranking the quantized distance is final and can be cut at the threshold directly,
+    // with re-ranking the true match may sit just above it, so the best candidates are kept regardless
+    const bool rerank = rerank_top_k > 0 && float_rows;
+    const size_t keep = rerank ? rerank_top_k : 1;
+    const float threshold = max_distance * max_distance;
+    std::vector<std::pair<float, size_t>> candidates;
+    candidates.reserve(keep + 1);
+    const size_t count = size();
+    for (size_t j = 0; j < count; ++j) {
+        float distance = storage_mode == StorageMode::Int8
+            ? squaredDistanceU8(prepared_query, codes.data() + j * DIMENSIONS, code_scales.data())
+            : squaredDistanceF16(prepared_query, halves.data() + j * DIMENSIONS);
+        if (candidates.size() == keep) {
+            if (distance >= candidates.back().first || isRemoved(j)) {
+                continue;
+            }
+            candidates.pop_back();
+        }
+        else if ((!rerank && distance >= threshold) || isRemoved(j)) {
+            continue;
+        }
+        candidates.insert(std::upper_bound(candidates.begin(), candidates.end(), std::make_pair(distance, j)), std::make_pair(distance, j));
+    }
+
+    Match match;
+    float best = threshold;
+    for (const auto& [distance, row] : candidates) {
+        float exact = rerank ? squaredDistanceF32(query, descriptor(row)) : distance;
+        if (exact < best) {
+            best = exact;
+            match.index = row;
+        }
+    }
+    if (match.index != static_cast<size_t>(-1)) {
+        match.label = label(match.index);
+        match.distance = std::sqrt(best);
+    }
+    return match;
+}
+
+DescriptorGallery::Match DescriptorGallery::findNearest(const dlib::matrix<float, 0, 1>& query, float max_distance) const {
+    if (query.size() != static_cast<long>(DIMENSIONS)) {
+        throw std::invalid_argument("Face descriptor must have 128 components");
+    }
+    return findNearest(&query(0), max_distance);
+}
+
+std::vector<DescriptorGallery::Match> DescriptorGallery::findNearest(const std::vector<dlib::matrix<float, 0, 1>>& queries, float max_distance) const {
+    std::vector<Match> matches(queries.size());
+    if (queries.empty() || empty()) {
+        return matches;
+    }
+    if (queries.size() == 1 || usesIndex() || storage_mode != StorageMode::Float32) {
+        for (size_t i = 0; i < queries.size(); ++i) {
+            matches[i] = findNearest(queries[i], max_distance);
+        }
+        return matches;
+    }
+
+    // |q - g|^2 = |q|^2 + |g|^2 - 2 q.g, the q.g terms of the whole frame come out of one product
+    const long query_count = static_cast<long>(queries.size());
+    dlib::matrix<float> query_rows(query_count, static_cast<long>(DIMENSIONS));
+    std::vector<float> query_norms(queries.size());
+    for (long i = 0; i < query_count; ++i) {
+        if (queries[i].size() != static_cast<long>(DIMENSIONS)) {
+            throw std::invalid_argument("Face descriptor must have 128 components");
+        }
+        dlib::set_rowm(query_rows, i) = dlib::trans(queries[i]);
+        query_norms[i] = dlib::length_squared(queries[i]);
+    }
+
+    const float threshold = max_distance * max_distance;
+    const float* norms = rowNorms();
+    std::vector<float> best(queries.size(), threshold);
+    dlib::matrix<float> dots;
+    for (size_t begin = 0; begin < size(); begin += GEMM_BLOCK_ROWS) {
+        const size_t rows = std::min(GEMM_BLOCK_ROWS, size() - begin);
+        dots = query_rows * dlib::trans(dlib::mat(descriptor(begin), static_cast<long>(rows), static_cast<long>(DIMENSIONS)));
+        for (long i = 0; i < query_count; ++i) {
+            for (size_t r = 0; r < rows; ++r) {
+                float distance = std::max(0.0f, query_norms[i] + norms[begin + r] - 2.0f * dots(i, static_cast<long>(r)));
+                if (distance < best[i] && !isRemoved(begin + r)) {
+                    best[i] = distance;
+                    matches[i].index = begin + r;
+                }
+            }
+        }
+    }
+
+    for (size_t i = 0; i < matches.size(); ++i) {
+        if (matches[i].index != static_cast<size_t>(-1)) {
+            matches[i].label = label(matches[i].index);
+            matches[i].distance = std::sqrt(best[i]);
+        }
+    }
+    return matches;
+}
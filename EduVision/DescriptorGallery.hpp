@@ -0,0 +1,140 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <optional>
+#include <string>
+#include <unordered_set>
+#include <vector>
+#include <dlib/matrix.h>
+
+#include "AlignedAllocator.hpp"
+#include "HnswIndex.hpp"
+
+// All enrolled face descriptors packed into one row-major float buffer.
+// Row i holds the 128 components of descriptor i, its squared norm is kept
+// alongside so a whole frame can be matched with a single matrix multiply.
+// A gallery loaded from a DescriptorStore reads the rows straight from the
+// mapped file and only copies them on its first change.
+// Large galleries can additionally carry an HNSW graph, searches then go
+// through the graph instead of scanning every row. For small machines the
+// scan and the graph can run over fp16 or per-dimension scaled 8-bit copies of the rows.
+class DescriptorGallery {
+public:
+    static constexpr size_t DIMENSIONS = 128;
+
+    enum class StorageMode {
+        Float32,
+        Float16,
+        Int8
+    };
+    // Below this many rows a linear scan beats the graph, so the index is not consulted
+    static constexpr size_t DEFAULT_EXACT_SEARCH_LIMIT = 5000;
+    static constexpr uint64_t EMPTY_FINGERPRINT = 14695981039346656037ull;
+
+    struct Match {
+        int label = -1;
+        float distance = std::numeric_limits<float>::max();
+        size_t index = static_cast<size_t>(-1);
+    };
+
+    DescriptorGallery() = default;
+    DescriptorGallery(const std::vector<dlib::matrix<float, 0, 1>>& descriptors, const std::vector<int>& labels);
+
+    void reserve(size_t count);
+    void add(const dlib::matrix<float, 0, 1>& descriptor, int label);
+    void add(const float* descriptor, int label);
+    // Replaces the contents with `count` contiguous rows that stay where they are, `owner` keeps them alive
+    // (the mapping of a DescriptorStore). The first add, reserve or release of the float rows copies them.
+    void assignMapped(std::shared_ptr<const void> owner, const float* rows, const float* row_squared_norms, const int* row_labels, size_t count, uint64_t fingerprint);
+    // Copies mapped rows into the gallery's own buffers and drops its reference to the mapping
+    void detachMapping();
+    // What keeps the mapped rows alive, empty once the gallery owns its rows
+    [[nodiscard]] const std::shared_ptr<const void>& getMapping() const { return mapping; }
+    void clear();
+
+    // Rows of a removed user stay in place but never match again
+    void removeLabel(int label) { removed_labels.insert(label); }
+    void restoreLabel(int label) { removed_labels.erase(label); }
+
+    [[nodiscard]] size_t size() const { return mapping ? mapped_count : labels.size(); }
+    [[nodiscard]] bool empty() const { return size() == 0; }
+    // Float rows are only available while hasFloatRows() is true
+    [[nodiscard]] const float* descriptor(size_t index) const { return (mapping ? mapped_rows : data.data()) + index * DIMENSIONS; }
+    [[nodiscard]] bool hasFloatRows() const { return float_rows; }
+    [[nodiscard]] int label(size_t index) const { return mapping ? mapped_labels[index] : labels[index]; }
+    // FNV-1a chained over every (descriptor, label) row, identifies which gallery a saved index belongs to.
+    // It is extended row by row, so appending never rehashes what is already there.
+    [[nodiscard]] uint64_t fingerprint() const { return content_fingerprint; }
+    static uint64_t extendFingerprint(uint64_t fingerprint, const float* descriptor, int label);
+
+    void buildIndex(const HnswIndex::Params& params = {});
+    // Loads the graph saved at `path` if it was built from this gallery, otherwise builds and saves
+    // a new one. Galleries smaller than the exact search limit get no index at all.
+    void prepareIndex(const std::string& path, const HnswIndex::Params& params = {});
+    void saveIndex(const std::string& path) const;
+    void dropIndex() { index.reset(); }
+    void setExactSearchLimit(size_t limit) { exact_search_limit = limit; }
+    void setEfSearch(size_t ef);
+    [[nodiscard]] bool usesIndex() const { return index.has_value() && size() >= exact_search_limit; }
+    // Row of a removed user, every search skips it
+    [[nodiscard]] bool isRemoved(size_t row) const { return !removed_labels.empty() && removed_labels.count(label(row)) != 0; }
+
+    // Distances the HNSW graph works with: fp32 in Float32 mode, otherwise over the quantized rows,
+    // so the index keeps working once the float rows are released. prepareQuery turns a float query
+    // and rowQuery a gallery row into the query form rowDistance expects, `buffer` holds DIMENSIONS floats.
+    [[nodiscard]] const float* prepareQuery(const float* query, float* buffer) const;
+    [[nodiscard]] const float* rowQuery(size_t index, float* buffer) const;
+    [[nodiscard]] float rowDistance(const float* prepared_query, size_t index) const;
+
+    // Quantized modes scan or search the graph over the 2 or 4 times smaller copy and, when rerank_top_k > 0,
+    // recompute the distance of the best rerank_top_k candidates in fp32. Without re-ranking the float
+    // rows are released, which is where the memory saving comes from.
+    void setStorageMode(StorageMode mode, size_t rerank_top_k = 0);
+    [[nodiscard]] StorageMode getStorageMode() const { return storage_mode; }
+    // Heap bytes of the rows, rows still read from a mapped store are not counted
+    [[nodiscard]] size_t memoryBytes() const;
+
+    // Closest descriptor by fp32 linear scan regardless of any index, the reference for recall checks
+    [[nodiscard]] Match findNearestExact(const float* query, float max_distance) const;
+
+    // Closest descriptor within max_distance, or a Match with label -1
+    [[nodiscard]] Match findNearest(const float* query, float max_distance) const;
+    [[nodiscard]] Match findNearest(const dlib::matrix<float, 0, 1>& query, float max_distance) const;
+
+    // Matches every query of a frame against the gallery in one GEMM per block of rows
+    [[nodiscard]] std::vector<Match> findNearest(const std::vector<dlib::matrix<float, 0, 1>>& queries, float max_distance) const;
+
+    // Squared euclidean distance between two DIMENSIONS-long vectors, AVX2/SSE when available
+    static float squaredDistance(const float* a, const float* b);
+
+private:
+    Match findNearestQuantized(const float* query, float max_distance) const;
+    [[nodiscard]] const float* rowNorms() const { return mapping ? mapped_norms : squared_norms.data(); }
+    void quantizeRow(const float* descriptor);
+    // Grows the 8-bit range of every dimension `row` falls outside of and re-encodes that dimension
+    void widenCodeRange(const float* row);
+
+    aligned_vector<float> data;
+    bool float_rows = true;
+    StorageMode storage_mode = StorageMode::Float32;
+    size_t rerank_top_k = 0;
+    aligned_vector<uint8_t> codes;
+    aligned_vector<uint16_t> halves;
+    std::vector<float> code_offsets;
+    std::vector<float> code_scales;
+    std::vector<float> squared_norms;
+    std::vector<int> labels;
+    // Rows, norms and labels are read from here instead of the vectors above while it is set
+    std::shared_ptr<const void> mapping;
+    const float* mapped_rows = nullptr;
+    const float* mapped_norms = nullptr;
+    const int* mapped_labels = nullptr;
+    size_t mapped_count = 0;
+    std::optional<HnswIndex> index;
+    size_t exact_search_limit = DEFAULT_EXACT_SEARCH_LIMIT;
+    uint64_t content_fingerprint = EMPTY_FINGERPRINT;
+    std::unordered_set<int> removed_labels;
+};
@@ -0,0 +1,218 @@
+#define _SILENCE_CXX17_CODECVT_HEADER_DEPRECATION_WARNING
+#define _SILENCE_ALL_CXX17_DEPRECATION_WARNINGS
+#define _CRT_SECURE_NO_WARNINGS
+
+#include "DescriptorKernels.hpp"
+#include "CpuFeatures.hpp"
+
+#include <cmath>
+#include <cstring>
+
+namespace {
+    constexpr size_t DIMENSIONS = DESCRIPTOR_DIMENSIONS;
+
+    float squaredDistanceF32Scalar(const float* a, const float* b) {
+        float sum = 0.0f;
+        for (size_t i = 0; i < DIMENSIONS; ++i) {
+            float d = a[i] - b[i];
+            sum += d * d;
+        }
+        return sum;
+    }
+
+    float squaredDistanceU8Scalar(const float* shifted_query, const uint8_t* codes, const float* scales) {
+        float sum = 0.0f;
+        for (size_t i = 0; i < DIMENSIONS; ++i) {
+            float d = shifted_query[i] - scales[i] * static_cast<float>(codes[i]);
+            sum += d * d;
+        }
+        return sum;
+    }
+
+    float squaredDistanceF16Scalar(const float* query, const uint16_t* halves) {
+        float sum = 0.0f;
+        for (size_t i = 0; i < DIMENSIONS; ++i) {
+            float d = query[i] - halfToFloat(halves[i]);
+            sum += d * d;
+        }
+        return sum;
+    }
+
+#if defined(EDUVISION_HAS_SSE2)
+    inline float horizontalSum(__m128 acc) {
+        acc = _mm_add_ps(acc, _mm_movehl_ps(acc, acc));
+        acc = _mm_add_ss(acc, _mm_shuffle_ps(acc, acc, 0x55));
+        return _mm_cvtss_f32(acc);
+    }
+
+    float squaredDistanceF32Sse(const float* a, const float* b) {
+        __m128 acc0 = _mm_setzero_ps();
+        __m128 acc1 = _mm_setzero_ps();
+        for (size_t i = 0; i < DIMENSIONS; i += 8) {
+            __m128 d0 = _mm_sub_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i));
+            __m128 d1 = _mm_sub_ps(_mm_loadu_ps(a + i + 4), _mm_loadu_ps(b + i + 4));
+            acc0 = _mm_add_ps(acc0, _mm_mul_ps(d0, d0));
+            acc1 = _mm_add_ps(acc1, _mm_mul_ps(d1, d1));
+        }
+        return horizontalSum(_mm_add_ps(acc0, acc1));
+    }
+
+    float squaredDistanceU8Sse(const float* shifted_query, const uint8_t* codes, const float* scales) {
+        const __m128i zero = _mm_setzero_si128();
+        __m128 acc = _mm_setzero_ps();
+        for (size_t i = 0; i < DIMENSIONS; i += 16) {
+            __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(codes + i));
+            __m128i words[2] = { _mm_unpacklo_epi8(bytes, zero), _mm_unpackhi_epi8(bytes, zero) };
+            for (size_t w = 0; w < 2; ++w) {
+                __m128 values[2] = {
+                    _mm_cvtepi32_ps(_mm_unpacklo_epi16(words[w], zero)),
+                    _mm_cvtepi32_ps(_mm_unpackhi_epi16(words[w], zero))
+                };
+                for (size_t v = 0; v < 2; ++v) {
+                    size_t offset = i + w * 8 + v * 4;
+                    __m128 d = _mm_sub_ps(_mm_loadu_ps(shifted_query + offset), _mm_mul_ps(_mm_loadu_ps(scales + offset), values[v]));
+                    acc = _mm_add_ps(acc, _mm_mul_ps(d, d));
+                }
+            }
+        }
+        return horizontalSum(acc);
+    }
+
+    EDUVISION_TARGET_AVX2 inline float horizontalSum256(__m256 acc) {
+        return horizontalSum(_mm_add_ps(_mm256_castps256_ps128(acc), _mm256_extractf128_ps(acc, 1)));
+    }
+
+    EDUVISION_TARGET_AVX2 float squaredDistanceF32Avx2(const float* a, const float* b) {
+        __m256 acc0 = _mm256_setzero_ps();
+        __m256 acc1 = _mm256_setzero_ps();
+        for (size_t i = 0; i < DIMENSIONS; i += 16) {
+            __m256 d0 = _mm256_sub_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i));
+            __m256 d1 = _mm256_sub_ps(_mm256_loadu_ps(a + i + 8), _mm256_loadu_ps(b + i + 8));
+            acc0 = _mm256_fmadd_ps(d0, d0, acc0);
+            acc1 = _mm256_fmadd_ps(d1, d1, acc1);
+        }
+        return horizontalSum256(_mm256_add_ps(acc0, acc1));
+    }
+
+    EDUVISION_TARGET_AVX2 float squaredDistanceU8Avx2(const float* shifted_query, const uint8_t* codes, const float* scales) {
+        __m256 acc0 = _mm256_setzero_ps();
+        __m256 acc1 = _mm256_setzero_ps();
+        for (size_t i = 0; i < DIMENSIONS; i += 16) {
+            __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(codes + i));
+            __m256 c0 = _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(bytes));
+            __m256 c1 = _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(_mm_srli_si128(bytes, 8)));
+            __m256 d0 = _mm256_fnmadd_ps(_mm256_loadu_ps(scales + i), c0, _mm256_loadu_ps(shifted_query + i));
+            __m256 d1 = _mm256_fnmadd_ps(_mm256_loadu_ps(scales + i + 8), c1, _mm256_loadu_ps(shifted_query + i + 8));
+            acc0 = _mm256_fmadd_ps(d0, d0, acc0);
+            acc1 = _mm256_fmadd_ps(d1, d1, acc1);
+        }
+        return horizontalSum256(_mm256_add_ps(acc0, acc1));
+    }
+
+    EDUVISION_TARGET_AVX2 float squaredDistanceF16Avx2(const float* query, const uint16_t* halves) {
+        __m256 acc0 = _mm256_setzero_ps();
+        __m256 acc1 = _mm256_setzero_ps();
+        for (size_t i = 0; i < DIMENSIONS; i += 16) {
+            __m256 h0 = _mm256_cvtph_ps(_mm_loadu_si128(reinterpret_cast<const __m128i*>(halves + i)));
+            __m256 h1 = _mm256_cvtph_ps(_mm_loadu_si128(reinterpret_cast<const __m128i*>(halves + i + 8)));
+            __m256 d0 = _mm256_sub_ps(_mm256_loadu_ps(query + i), h0);
+            __m256 d1 = _mm256_sub_ps(_mm256_loadu_ps(query + i + 8), h1);
+            acc0 = _mm256_fmadd_ps(d0, d0, acc0);
+            acc1 = _mm256_fmadd_ps(d1, d1, acc1);
+        }
+        return horizontalSum256(_mm256_add_ps(acc0, acc1));
+    }
+#endif
+
+    struct Kernels {
+        float (*f32)(const float*, const float*) = squaredDistanceF32Scalar;
+        float (*u8)(const float*, const uint8_t*, const float*) = squaredDistanceU8Scalar;
+        // Without F16C the conversion is done in software, only the memory saving remains
+        float (*f16)(const float*, const uint16_t*) = squaredDistanceF16Scalar;
+    };
+
+    Kernels selectKernels() {
+        Kernels kernels;
+#if defined(EDUVISION_HAS_SSE2)
+        kernels.f32 = squaredDistanceF32Sse;
+        kernels.u8 = squaredDistanceU8Sse;
+        if (cpuSupportsAvx2()) {
+            kernels.f32 = squaredDistanceF32Avx2;
+            kernels.u8 = squaredDistanceU8Avx2;
+            kernels.f16 = squaredDistanceF16Avx2;
+        }
+#endif
+        return kernels;
+    }
+
+    const Kernels kernels = selectKernels();
+}
+
+float squaredDistanceF32(const float* a, const float* b) {
+    return kernels.f32(a, b);
+}
+
+float squaredDistanceU8(const float* shifted_query, const uint8_t* codes, const float* scales) {
+    return kernels.u8(shifted_query, codes, scales);
+}
+
+float squaredDistanceF16(const float* query, const uint16_t* halves) {
+    return kernels.f16(query, halves);
+}
+
+uint16_t floatToHalf(float value) {
+    uint32_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    const uint16_t sign = static_cast<uint16_t>((bits >> 16) & 0x8000);
+    const uint32_t magnitude = bits & 0x7fffffff;
+
+    if (magnitude >= 0x47800000) {
+        // Out of range, infinity or NaN
+        return sign | (magnitude > 0x7f800000 ? 0x7e00 : 0x7c00);
+    }
+    if (magnitude < 0x38800000) {
+        // Subnormal half, or zero when below half of the smallest subnormal
+        if (magnitude < 0x33000000) {
+            return sign;
+        }
+        const uint32_t exponent = magnitude >> 23;
+        const uint32_t mantissa = (magnitude & 0x7fffff) | 0x800000;
+        const uint32_t shift = 126 - exponent;
+        uint32_t half = mantissa >> shift;
+        const uint32_t remainder = mantissa & ((1u << shift) - 1);
+        const uint32_t halfway = 1u << (shift - 1);
+        if (remainder > halfway || (remainder == halfway && (half & 1))) {
+            ++half;
+        }
+        return sign | static_cast<uint16_t>(half);
+    }
+
+    // Re-bias the exponent from 127 to 15 and round the mantissa to nearest even
+    uint32_t half = (magnitude - 0x38000000) >> 13;
+    const uint32_t remainder = magnitude & 0x1fff;
+    if (remainder > 0x1000 || (remainder == 0x1000 && (half & 1))) {
+        ++half;
+    }
+    return sign | static_cast<uint16_t>(half);
+}
+
+float halfToFloat(uint16_t value) {
+    const uint32_t sign = static_cast<uint32_t>(value & 0x8000) << 16;
+    const uint32_t exponent = (value >> 10) & 0x1f;
+    const uint32_t mantissa = value & 0x3ff;
+
+    uint32_t bits;
+    if (exponent == 0) {
+        float magnitude = std::ldexp(static_cast<float>(mantissa), -24);
+        return sign ? -magnitude : magnitude;
+    }
+    if (exponent == 31) {
+        bits = sign | 0x7f800000 | (mantissa << 13);
+    }
+    else {
+        bits = sign | ((exponent + 112) << 23) | (mantissa << 13);
+    }
+    float result;
+    std::memcpy(&result, &bits, sizeof(result));
+    return result;
+}
@@ -0,0 +1,22 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Distance kernels over 128-component face descriptors. Every function is
+// dispatched once at start-up to an AVX2/FMA/F16C, SSE2 or scalar version.
+
+constexpr size_t DESCRIPTOR_DIMENSIONS = 128;
+
+// Squared euclidean distance between two float descriptors
+float squaredDistanceF32(const float* a, const float* b);
+
+// Squared distance between a float query and a row of 8-bit codes, where component d of the row is
+// offsets[d] + scales[d] * code[d]. `shifted_query` is the query with the offsets already subtracted.
+float squaredDistanceU8(const float* shifted_query, const uint8_t* codes, const float* scales);
+
+// Squared distance between a float query and a row of IEEE half precision values
+float squaredDistanceF16(const float* query, const uint16_t* halves);
+
+uint16_t floatToHalf(float value);
+float halfToFloat(uint16_t value);
@@ -0,0 +1,434 @@
+#define _SILENCE_CXX17_CODECVT_HEADER_DEPRECATION_WARNING
+#define _SILENCE_ALL_CXX17_DEPRECATION_WARNINGS
+#define _CRT_SECURE_NO_WARNINGS
+
+#include "DescriptorStore.hpp"
+#include "DescriptorGallery.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <stdexcept>
+#include <unordered_set>
+
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace fs = std::filesystem;
+
+namespace {
+    constexpr char MAGIC[8] = { 'E', 'V', 'D', 'E', 'S', 'C', 'R', '\0' };
+    constexpr uint64_t HEADER_SIZE = 4096;
+    constexpr uint64_t MIN_CAPACITY = 1024;
+    constexpr uint64_t MIN_TOMBSTONE_CAPACITY = 64;
+    constexpr uint64_t ROW_BYTES = DescriptorGallery::DIMENSIONS * sizeof(float);
+
+    static_assert(sizeof(DescriptorStore::Header) <= HEADER_SIZE, "Store header must fit its page");
+
+    uint64_t alignUp(uint64_t value, uint64_t alignment) {
+        return (value + alignment - 1) / alignment * alignment;
+    }
+
+    DescriptorStore::Header layout(uint64_t capacity, uint64_t tombstone_capacity) {
+        DescriptorStore::Header header{};
+        std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+        header.version = DescriptorStore::VERSION;
+        header.dimensions = static_cast<uint32_t>(DescriptorGallery::DIMENSIONS);
+        header.capacity = capacity;
+        header.tombstone_capacity = tombstone_capacity;
+        header.fingerprint = DescriptorGallery::EMPTY_FINGERPRINT;
+        header.descriptors_offset = HEADER_SIZE;
+        header.norms_offset = alignUp(header.descriptors_offset + capacity * ROW_BYTES, 64);
+        header.labels_offset = alignUp(header.norms_offset + capacity * sizeof(float), 64);
+        header.tombstones_offset = alignUp(header.labels_offset + capacity * sizeof(int32_t), 64);
+        header.file_size = alignUp(header.tombstones_offset + tombstone_capacity * sizeof(int32_t), HEADER_SIZE);
+        return header;
+    }
+
+    void validate(const DescriptorStore::Header& header, uint64_t file_size, const std::string& path) {
+        if (std::memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0 || header.version != DescriptorStore::VERSION
+            || header.dimensions != DescriptorGallery::DIMENSIONS || header.count > header.capacity
+            || header.tombstone_count > header.tombstone_capacity || header.file_size > file_size) {
+            throw std::runtime_error(path + " is not a valid descriptor store");
+        }
+    }
+
+    // Read-only mapping of a whole file, pages are faulted in only when touched
+    class MappedFile {
+    public:
+        explicit MappedFile(const std::string& path) {
+#if defined(_WIN32)
+            file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+            LARGE_INTEGER file_size;
+            if (file == INVALID_HANDLE_VALUE || !GetFileSizeEx(file, &file_size)) {
+                close();
+                throw std::runtime_error("Unable to open " + path);
+            }
+            length = static_cast<size_t>(file_size.QuadPart);
+            mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+            view = mapping ? static_cast<const unsigned char*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0)) : nullptr;
+#else
+            fd = ::open(path.c_str(), O_RDONLY);
+            struct stat info;
+            if (fd < 0 || ::fstat(fd, &info) != 0) {
+                close();
+                throw std::runtime_error("Unable to open " + path);
+            }
+            length = static_cast<size_t>(info.st_size);
+            void* address = ::mmap(nullptr, length, PROT_READ, MAP_SHARED, fd, 0);
+            view = address == MAP_FAILED ? nullptr : static_cast<const unsigned char*>(address);
+#endif
+            if (view == nullptr) {
+                close();
+                throw std::runtime_error("Unable to map " + path);
+            }
+        }
+
+        ~MappedFile() { close(); }
+
+        MappedFile(const MappedFile&) = delete;
+        MappedFile& operator=(const MappedFile&) = delete;
+
+        [[nodiscard]] const unsigned char* data() const { return view; }
+        [[nodiscard]] size_t size() const { return length; }
+
+        [[nodiscard]] const DescriptorStore::Header& header(const std::string& path) const {
+            if (length < HEADER_SIZE) {
+                throw std::runtime_error(path + " is not a valid descriptor store");
+            }
+            const auto& header = *reinterpret_cast<const DescriptorStore::Header*>(view);
+            validate(header, length, path);
+            return header;
+        }
+
+        template <typename T>
+        [[nodiscard]] const T* at(uint64_t offset) const { return reinterpret_cast<const T*>(view + offset); }
+
+    private:
+        void close() {
+#if defined(_WIN32)
+            if (view) UnmapViewOfFile(view);
+            if (mapping) CloseHandle(mapping);
+            if (file != INVALID_HANDLE_VALUE) CloseHandle(file);
+            mapping = nullptr;
+            file = INVALID_HANDLE_VALUE;
+#else
+            if (view) ::munmap(const_cast<unsigned char*>(view), length);
+            if (fd >= 0) ::close(fd);
+            fd = -1;
+#endif
+            view = nullptr;
+        }
+
+#if defined(_WIN32)
+        HANDLE file = INVALID_HANDLE_VALUE;
+        HANDLE mapping = nullptr;
+#else
+        int fd = -1;
+#endif
+        const unsigned char* view = nullptr;
+        size_t length = 0;
+    };
+
+    void writeAt(std::fstream& file, uint64_t offset, const void* bytes, size_t length) {
+        file.seekp(static_cast<std::streamoff>(offset));
+        file.write(static_cast<const char*>(bytes), static_cast<std::streamsize>(length));
+        if (!file) {
+            throw std::runtime_error("Error writing descriptor store");
+        }
+    }
+
+    std::fstream openForWrite(const std::string& path) {
+        std::fstream file(path, std::ios::in | std::ios::out | std::ios::binary);
+        if (!file) {
+            throw std::runtime_error("Unable to open " + path + " for writing");
+        }
+        return file;
+    }
+
+    // Empty file of the header's size with the header in place, unused slots read as zeros
+    void createFile(const std::string& path, const DescriptorStore::Header& header) {
+        {
+            std::ofstream out(path, std::ios::binary | std::ios::trunc);
+            out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+            if (!out) {
+                throw std::runtime_error("Unable to create " + path);
+            }
+        }
+        fs::resize_file(path, header.file_size);
+    }
+
+    void flattenRows(const std::vector<dlib::matrix<float, 0, 1>>& descriptors, const std::vector<int>& labels,
+        std::vector<float>& rows, std::vector<float>& norms, uint64_t& fingerprint) {
+        if (descriptors.size() != labels.size()) {
+            throw std::invalid_argument("Descriptor and label counts differ");
+        }
+        rows.resize(descriptors.size() * DescriptorGallery::DIMENSIONS);
+        norms.resize(descriptors.size());
+        for (size_t i = 0; i < descriptors.size(); ++i) {
+            if (descriptors[i].size() != static_cast<long>(DescriptorGallery::DIMENSIONS)) {
+                throw std::invalid_argument("Face descriptor must have 128 components");
+            }
+            float* row = rows.data() + i * DescriptorGallery::DIMENSIONS;
+            norms[i] = 0.0f;
+            for (size_t d = 0; d < DescriptorGallery::DIMENSIONS; ++d) {
+                row[d] = descriptors[i](static_cast<long>(d));
+                norms[i] += row[d] * row[d];
+            }
+            fingerprint = DescriptorGallery::extendFingerprint(fingerprint, row, labels[i]);
+        }
+    }
+}
+
+DescriptorStore::DescriptorStore(std::string path) : path(std::move(path)) {
+    if (!fs::exists(this->path)) {
+        header = layout(MIN_CAPACITY, MIN_TOMBSTONE_CAPACITY);
+        createFile(this->path, header);
+        return;
+    }
+    loadHeader();
+}
+
+void DescriptorStore::loadHeader() {
+    std::ifstream in(path, std::ios::binary);
+    in.read(reinterpret_cast<char*>(&header), sizeof(header));
+    if (!in) {
+        throw std::runtime_error(path + " is not a valid descriptor store");
+    }
+    validate(header, static_cast<uint64_t>(fs::file_size(path)), path);
+}
+
+void DescriptorStore::write(const std::string& path, const std::vector<dlib::matrix<float, 0, 1>>& descriptors, const std::vector<int>& labels) {
+    std::vector<float> rows, norms;
+    uint64_t fingerprint = DescriptorGallery::EMPTY_FINGERPRINT;
+    flattenRows(descriptors, labels, rows, norms, fingerprint);
+
+    const uint64_t count = descriptors.size();
+    Header header = layout(std::max(MIN_CAPACITY, count + count / 2), MIN_TOMBSTONE_CAPACITY);
+    const std::string temporary = path + ".tmp";
+    createFile(temporary, header);
+    {
+        std::fstream file = openForWrite(temporary);
+        writeAt(file, header.descriptors_offset, rows.data(), rows.size() * sizeof(float));
+        writeAt(file, header.norms_offset, norms.data(), norms.size() * sizeof(float));
+        writeAt(file, header.labels_offset, labels.data(), labels.size() * sizeof(int32_t));
+        header.count = count;
+        header.fingerprint = fingerprint;
+        writeAt(file, 0, &header, sizeof(header));
+    }
+    fs::rename(temporary, path);
+}
+
+void DescriptorStore::append(const std::vector<dlib::matrix<float, 0, 1>>& descriptors, const std::vector<int>& labels) {
+    if (descriptors.empty()) {
+        return;
+    }
+    loadHeader();
+    std::vector<float> rows, norms;
+    uint64_t fingerprint = header.fingerprint;
+    flattenRows(descriptors, labels, rows, norms, fingerprint);
+
+    const uint64_t count = header.count + descriptors.size();
+    if (count > header.capacity) {
+        rewrite(std::max(header.capacity * 2, count), header.tombstone_capacity, false);
+    }
+
+    std::fstream file = openForWrite(path);
+    writeAt(file, header.descriptors_offset + header.count * ROW_BYTES, rows.data(), rows.size() * sizeof(float));
+    writeAt(file, header.norms_offset + header.count * sizeof(float), norms.data(), norms.size() * sizeof(float));
+    writeAt(file, header.labels_offset + header.count * sizeof(int32_t), labels.data(), labels.size() * sizeof(int32_t));
+    file.flush();
+
+    // The rows only become part of the store once the header says so
+    header.count = count;
+    header.fingerprint = fingerprint;
+    writeAt(file, 0, &header, sizeof(header));
+    file.flush();
+}
+
+void DescriptorStore::replaceLabel(int label, const std::vector<dlib::matrix<float, 0, 1>>& descriptors) {
+    loadHeader();
+    bool known = false;
+    {
+        MappedFile file(path);
+        const Header& current = file.header(path);
+        const int32_t* labels = file.at<int32_t>(current.labels_offset);
+        const int32_t* tombstones = file.at<int32_t>(current.tombstones_offset);
+        known = std::find(labels, labels + current.count, label) != labels + current.count
+            || std::find(tombstones, tombstones + current.tombstone_count, label) != tombstones + current.tombstone_count;
+    }
+    if (!known) {
+        append(descriptors, std::vector<int>(descriptors.size(), label));
+        return;
+    }
+    rewrite(header.capacity, header.tombstone_capacity, false, label, descriptors);
+}
+
+std::vector<int> DescriptorStore::getTombstones() const {
+    std::vector<int> tombstones(static_cast<size_t>(header.tombstone_count));
+    std::ifstream in(path, std::ios::binary);
+    in.seekg(static_cast<std::streamoff>(header.tombstones_offset));
+    in.read(reinterpret_cast<char*>(tombstones.data()), static_cast<std::streamsize>(tombstones.size() * sizeof(int32_t)));
+    if (!in) {
+        throw std::runtime_error("Error reading tombstones of " + path);
+    }
+    return tombstones;
+}
+
+void DescriptorStore::removeLabel(int label) {
+    loadHeader();
+    std::vector<int> tombstones = getTombstones();
+    if (std::find(tombstones.begin(), tombstones.end(), label) != tombstones.end()) {
+        return;
+    }
+    if (header.tombstone_count == header.tombstone_capacity) {
+        rewrite(header.capacity, header.tombstone_capacity * 2, false);
+    }
+    std::fstream file = openForWrite(path);
+    writeAt(file, header.tombstones_offset + header.tombstone_count * sizeof(int32_t), &label, sizeof(int32_t));
+    file.flush();
+    ++header.tombstone_count;
+    writeAt(file, 0, &header, sizeof(header));
+    file.flush();
+}
+
+void DescriptorStore::compact() {
+    loadHeader();
+    rewrite(0, MIN_TOMBSTONE_CAPACITY, true);
+}
+
+void DescriptorStore::rewrite(uint64_t capacity, uint64_t tombstone_capacity, bool drop_removed, std::optional<int> replaced_label,
+    const std::vector<dlib::matrix<float, 0, 1>>& replacement) {
+    const std::string temporary = path + ".tmp";
+    std::vector<float> replacement_rows, replacement_norms;
+    // The fingerprint of the file chains on from the kept rows, flattenRows' own one is not used
+    uint64_t replacement_fingerprint = DescriptorGallery::EMPTY_FINGERPRINT;
+    std::vector<int> replacement_labels;
+    if (replaced_label) {
+        replacement_labels.assign(replacement.size(), *replaced_label);
+        flattenRows(replacement, replacement_labels, replacement_rows, replacement_norms, replacement_fingerprint);
+    }
+    Header rewritten;
+    {
+        MappedFile source(path);
+        const Header& current = source.header(path);
+        const float* rows = source.at<float>(current.descriptors_offset);
+        const float* norms = source.at<float>(current.norms_offset);
+        const int32_t* labels = source.at<int32_t>(current.labels_offset);
+        const int32_t* tombstones = source.at<int32_t>(current.tombstones_offset);
+
+        const bool filtered = drop_removed || replaced_label.has_value();
+        std::vector<uint64_t> kept;
+        if (filtered) {
+            std::unordered_set<int32_t> removed;
+            if (drop_removed) {
+                removed.insert(tombstones, tombstones + current.tombstone_count);
+            }
+            if (replaced_label) {
+                removed.insert(*replaced_label);
+            }
+            for (uint64_t i = 0; i < current.count; ++i) {
+                if (removed.count(labels[i]) == 0) {
+                    kept.push_back(i);
+                }
+            }
+        }
+        const uint64_t count = (filtered ? kept.size() : current.count) + replacement_labels.size();
+        if (capacity == 0) {
+            capacity = std::max(MIN_CAPACITY, count + count / 2);
+        }
+
+        rewritten = layout(std::max(capacity, count), std::max(tombstone_capacity, drop_removed ? 0 : current.tombstone_count));
+        createFile(temporary, rewritten);
+        std::fstream file = openForWrite(temporary);
+        if (filtered) {
+            uint64_t fingerprint = DescriptorGallery::EMPTY_FINGERPRINT;
+            for (uint64_t i = 0; i < kept.size(); ++i) {
+                const uint64_t row = kept[i];
+                writeAt(file, rewritten.descriptors_offset + i * ROW_BYTES, rows + row * DescriptorGallery::DIMENSIONS, ROW_BYTES);
+                writeAt(file, rewritten.norms_offset + i * sizeof(float), norms + row, sizeof(float));
+                writeAt(file, rewritten.labels_offset + i * sizeof(int32_t), labels + row, sizeof(int32_t));
+                fingerprint = DescriptorGallery::extendFingerprint(fingerprint, rows + row * DescriptorGallery::DIMENSIONS, labels[row]);
+            }
+            // The replacement rows follow the kept ones, the fingerprint chains on over them
+            const uint64_t first = kept.size();
+            for (size_t i = 0; i < replacement_labels.size(); ++i) {
+                const float* row = replacement_rows.data() + i * DescriptorGallery::DIMENSIONS;
+                fingerprint = DescriptorGallery::extendFingerprint(fingerprint, row, replacement_labels[i]);
+            }
+            if (!replacement_labels.empty()) {
+                writeAt(file, rewritten.descriptors_offset + first * ROW_BYTES, replacement_rows.data(), replacement_rows.size() * sizeof(float));
+                writeAt(file, rewritten.norms_offset + first * sizeof(float), replacement_norms.data(), replacement_norms.size() * sizeof(float));
+                writeAt(file, rewritten.labels_offset + first * sizeof(int32_t), replacement_labels.data(), replacement_labels.size() * sizeof(int32_t));
+            }
+            rewritten.fingerprint = fingerprint;
+            if (!drop_removed) {
+                std::vector<int32_t> kept_tombstones(tombstones, tombstones + current.tombstone_count);
+                if (replaced_label) {
+                    kept_tombstones.erase(std::remove(kept_tombstones.begin(), kept_tombstones.end(), *replaced_label), kept_tombstones.end());
+                }
+                writeAt(file, rewritten.tombstones_offset, kept_tombstones.data(), kept_tombstones.size() * sizeof(int32_t));
+                rewritten.tombstone_count = kept_tombstones.size();
+            }
+        }
+        else {
+            writeAt(file, rewritten.descriptors_offset, rows, count * ROW_BYTES);
+            writeAt(file, rewritten.norms_offset, norms, count * sizeof(float));
+            writeAt(file, rewritten.labels_offset, labels, count * sizeof(int32_t));
+            writeAt(file, rewritten.tombstones_offset, tombstones, current.tombstone_count * sizeof(int32_t));
+            rewritten.tombstone_count = current.tombstone_count;
+            rewritten.fingerprint = current.fingerprint;
+        }
+        rewritten.count = count;
+        writeAt(file, 0, &rewritten, sizeof(rewritten));
+    }
+    // The mapping is closed at this point, which Windows requires before the file can be replaced
+    fs::rename(temporary, path);
+    header = rewritten;
+}
+
+void DescriptorStore::read(DescriptorGallery& gallery) const {
+    // The gallery keeps the mapping and reads its rows from it, nothing is copied here
+    auto file = std::make_shared<MappedFile>(path);
+    const Header& current = file->header(path);
+    gallery.assignMapped(file, file->at<float>(current.descriptors_offset), file->at<float>(current.norms_offset),
+        file->at<int32_t>(current.labels_offset), static_cast<size_t>(current.count), current.fingerprint);
+    const int32_t* tombstones = file->at<int32_t>(current.tombstones_offset);
+    for (uint64_t i = 0; i < current.tombstone_count; ++i) {
+        gallery.removeLabel(tombstones[i]);
+    }
+}
+
+void DescriptorStore::read(std::vector<dlib::matrix<float, 0, 1>>& descriptors, std::vector<int>& labels) const {
+    MappedFile file(path);
+    const Header& current = file.header(path);
+    const float* rows = file.at<float>(current.descriptors_offset);
+    const int32_t* row_labels = file.at<int32_t>(current.labels_offset);
+    const int32_t* tombstones = file.at<int32_t>(current.tombstones_offset);
+    std::unordered_set<int32_t> removed(tombstones, tombstones + current.tombstone_count);
+
+    descriptors.clear();
+    labels.clear();
+    for (uint64_t i = 0; i < current.count; ++i) {
+        if (removed.count(row_labels[i]) != 0) {
+            continue;
+        }
+        dlib::matrix<float, 0, 1> descriptor(static_cast<long>(DescriptorGallery::DIMENSIONS));
+        const float* row = rows + i * DescriptorGallery::DIMENSIONS;
+        for (size_t d = 0; d < DescriptorGallery::DIMENSIONS; ++d) {
+            descriptor(static_cast<long>(d)) = row[d];
+        }
+        descriptors.push_back(std::move(descriptor));
+        labels.push_back(row_labels[i]);
+    }
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <vector>
+#include <dlib/matrix.h>
+
+class DescriptorGallery;
+
+// Versioned, append-only file of face descriptors that replaces the dlib
+// serialized face_descriptors.dat. Layout (little endian):
+//
+//   header       4096 bytes, see DescriptorStore::Header
+//   descriptors  capacity x 128 floats, row i is descriptor i
+//   norms        capacity x float, squared norm of every row
+//   labels       capacity x int32, user id of every row
+//   tombstones   tombstone_capacity x int32, ids of removed users
+//
+// Rows are written into the preallocated slots first and become visible once
+// the header with the new count is written, so an interrupted enrollment never
+// leaves a half written row behind. The file is only rewritten when a block runs
+// out of capacity (doubling) or by compact().
+class DescriptorStore {
+public:
+    static constexpr uint32_t VERSION = 1;
+
+    struct Header {
+        char magic[8];
+        uint32_t version;
+        uint32_t dimensions;
+        uint64_t capacity;
+        uint64_t count;
+        uint64_t tombstone_capacity;
+        uint64_t tombstone_count;
+        uint64_t fingerprint;
+        uint64_t descriptors_offset;
+        uint64_t norms_offset;
+        uint64_t labels_offset;
+        uint64_t tombstones_offset;
+        uint64_t file_size;
+    };
+
+    // Opens the store at `path`, creating an empty one when the file does not exist
+    explicit DescriptorStore(std::string path);
+
+    // Atomically replaces the store at `path` with exactly these rows and no tombstones
+    static void write(const std::string& path, const std::vector<dlib::matrix<float, 0, 1>>& descriptors, const std::vector<int>& labels);
+
+    void append(const std::vector<dlib::matrix<float, 0, 1>>& descriptors, const std::vector<int>& labels);
+    // Makes these rows the only rows of `label` and clears its tombstone. Rows of a label the store does not
+    // hold yet are appended; earlier rows or a tombstone, e.g. of a user enrolled again, are replaced by one
+    // rewrite of the file, so a crash leaves either the old rows or the new ones.
+    void replaceLabel(int label, const std::vector<dlib::matrix<float, 0, 1>>& descriptors);
+    void removeLabel(int label);
+    // Offline compaction: drops the rows of removed users, clears the tombstones and trims capacity
+    void compact();
+
+    // Maps the file and hands its rows to `gallery` without copying them, tombstoned users are marked removed.
+    // The gallery holds the mapping until its first change; on Windows the file can not be rewritten meanwhile.
+    void read(DescriptorGallery& gallery) const;
+    // Live rows only, for the offline tools
+    void read(std::vector<dlib::matrix<float, 0, 1>>& descriptors, std::vector<int>& labels) const;
+
+    [[nodiscard]] size_t size() const { return static_cast<size_t>(header.count); }
+    [[nodiscard]] const std::string& getPath() const { return path; }
+    [[nodiscard]] std::vector<int> getTombstones() const;
+
+private:
+    void loadHeader();
+    // `drop_removed` drops the rows of tombstoned users along with the tombstones. `replaced_label` loses its rows
+    // and its tombstone, `replacement` is written in their place.
+    void rewrite(uint64_t capacity, uint64_t tombstone_capacity, bool drop_removed, std::optional<int> replaced_label = std::nullopt,
+        const std::vector<dlib::matrix<float, 0, 1>>& replacement = {});
+
+    std::string path;
+    Header header{};
+};
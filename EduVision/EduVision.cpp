@@ -1,7 +1,10 @@
 ﻿// EduVision.cpp : Этот файл содержит функцию "main". Здесь начинается и заканчивается выполнение программы.
 //
 
+#include <algorithm>
 #include <iostream>
+#include <sstream>
+#include <type_traits>
 #include "FaceRecognition.hpp"
 #include <opencv2/opencv.hpp>
 #include <opencv2/objdetect.hpp>
@@ -9,8 +12,252 @@
 
 #include "User.hpp"
 #include "AppUI.hpp"
+#include "BatchProcessor.hpp"
+#include "Benchmark.hpp"
+#include "Metrics.hpp"
+
+namespace {
+    // Value following `name` on the command line, or `fallback` when the option is absent
+    std::string optionValue(int argc, char** argv, const std::string& name, const std::string& fallback) {
+        for (int i = 1; i + 1 < argc; ++i) {
+            if (name == argv[i]) {
+                return argv[i + 1];
+            }
+        }
+        return fallback;
+    }
+
+    // The whole of `value` as a number, std::invalid_argument naming `name` when it is none or out of range
+    template <typename T>
+    T parseNumber(const std::string& value, const std::string& name) {
+        std::istringstream in(value);
+        T number{};
+        if (value.empty() || (std::is_unsigned_v<T> && value.find('-') != std::string::npos)
+            || !(in >> number) || !(in >> std::ws).eof()) {
+            throw std::invalid_argument("Invalid value \"" + value + "\" for " + name);
+        }
+        return number;
+    }
+
+    // Number following `name` on the command line, or `fallback` when the option is absent
+    template <typename T>
+    T numberOption(int argc, char** argv, const std::string& name, T fallback) {
+        for (int i = 1; i + 1 < argc; ++i) {
+            if (name == argv[i]) {
+                return parseNumber<T>(argv[i + 1], name);
+            }
+        }
+        return fallback;
+    }
+
+    // Every value of an option that may be repeated
+    std::vector<std::string> optionValues(int argc, char** argv, const std::string& name) {
+        std::vector<std::string> values;
+        for (int i = 1; i + 1 < argc; ++i) {
+            if (name == argv[i]) {
+                values.push_back(argv[++i]);
+            }
+        }
+        return values;
+    }
+
+    // --detector haar|hog|dnn [--min-face <pixels>] [--pyramid-step <ratio>] [--detector-model <onnx>] [--detector-score <0..1>]
+    FaceDetector::Params detectorParams(int argc, char** argv) {
+        FaceDetector::Params params;
+        params.backend = FaceDetector::parseBackend(optionValue(argc, argv, "--detector", FaceDetector::backendName(params.backend)));
+        params.min_face_size = numberOption(argc, argv, "--min-face", params.min_face_size);
+        params.pyramid_step = numberOption(argc, argv, "--pyramid-step", params.pyramid_step);
+        params.dnn_model_path = optionValue(argc, argv, "--detector-model", params.dnn_model_path);
+        params.score_threshold = numberOption(argc, argv, "--detector-score", params.score_threshold);
+        return params;
+    }
+
+    // One-time conversion of a dlib serialized face_descriptors.dat into the descriptor store
+    void migrateDescriptorFile() {
+        const std::pair<const char*, const char*> files[] = {
+            { "models/face_descriptors.dat", FaceRecognizer::DESCRIPTOR_STORE_PATH },
+            { "models/face_descriptors_full.dat", FaceRecognizer::FULL_DESCRIPTOR_STORE_PATH }
+        };
+        for (const auto& [legacy_path, store_path] : files) {
+            if (fs::exists(legacy_path) && !fs::exists(store_path)) {
+                std::vector<matrix<float, 0, 1>> face_descriptors;
+                std::vector<int> labels;
+                deserialize(legacy_path) >> face_descriptors >> labels;
+                DescriptorStore::write(store_path, face_descriptors, labels);
+                std::cout << "Converted " << legacy_path << " to " << store_path << std::endl;
+            }
+        }
+    }
+
+    // Reads the trained face descriptors and applies --gallery-storage/--rerank, false when they can not be read
+    bool loadGallery(int argc, char** argv, DescriptorGallery& gallery) {
+        // Чтение обученных дескрипторов лиц и меток
+        try {
+            migrateDescriptorFile();
+            DescriptorStore(FaceRecognizer::DESCRIPTOR_STORE_PATH).read(gallery);
+        }
+        catch (const std::exception& e) {
+            std::cerr << "Error loading face descriptors: " << e.what() << std::endl;
+            return false;
+        }
+
+        gallery.prepareIndex(FaceRecognizer::INDEX_PATH);
+
+        // --gallery-storage fp32|fp16|int8 [--rerank <top k>]
+        std::string storage = optionValue(argc, argv, "--gallery-storage", "fp32");
+        size_t rerank_top_k = numberOption<size_t>(argc, argv, "--rerank", 0);
+        if (storage == "fp16") {
+            gallery.setStorageMode(DescriptorGallery::StorageMode::Float16, rerank_top_k);
+        }
+        else if (storage == "int8") {
+            gallery.setStorageMode(DescriptorGallery::StorageMode::Int8, rerank_top_k);
+        }
+        return true;
+    }
+
+    // --metrics-file <prometheus text file> --metrics-log <json lines file> [--metrics-interval <seconds>],
+    // nothing is exported when neither file is given
+    std::unique_ptr<MetricsExporter> startMetricsExporter(int argc, char** argv) {
+        std::string prometheus_path = optionValue(argc, argv, "--metrics-file", "");
+        std::string json_log_path = optionValue(argc, argv, "--metrics-log", "");
+        if (prometheus_path.empty() && json_log_path.empty()) {
+            return nullptr;
+        }
+        std::chrono::seconds interval(numberOption<long>(argc, argv, "--metrics-interval", 10));
+        return std::make_unique<MetricsExporter>(prometheus_path, json_log_path, interval);
+    }
+
+    // --batch [--frame-stride <n>] [--batch-workers <n>] [--segment-minutes <m>] <video>[@YYYY-MM-DDTHH:MM:SS]...
+    int runBatch(int argc, char** argv) {
+        std::vector<BatchProcessor::Recording> recordings;
+        for (int i = 2; i < argc; ++i) {
+            if (std::string(argv[i]).rfind("--", 0) == 0) {
+                ++i; // Every option takes a value
+                continue;
+            }
+            recordings.push_back(BatchProcessor::parseRecording(argv[i]));
+        }
+        if (recordings.empty()) {
+            std::cerr << "No video files given to --batch" << std::endl;
+            return -1;
+        }
+
+        try {
+            BatchProcessor::Options options;
+            options.frame_stride = numberOption<size_t>(argc, argv, "--frame-stride", 1);
+            options.workers = numberOption<size_t>(argc, argv, "--batch-workers", 0);
+            options.segment_minutes = numberOption(argc, argv, "--segment-minutes", 10.0);
+
+            UserRepository userRepository;
+            FaceRecognizer faceRecognizer(userRepository);
+            faceRecognizer.setDetectorParams(detectorParams(argc, argv));
+            DescriptorGallery gallery;
+            if (!loadGallery(argc, argv, gallery)) {
+                return -1;
+            }
+            SharedGallery shared_gallery(std::move(gallery));
+            std::unique_ptr<MetricsExporter> metrics_exporter = startMetricsExporter(argc, argv);
+            BatchProcessor processor(faceRecognizer, shared_gallery, options);
+            size_t failed = processor.run(recordings, std::cout);
+            for (const std::string& user : faceRecognizer.getUpdatedUsers()) {
+                std::cout << user << std::endl;
+            }
+            return failed == 0 ? 0 : -1;
+        }
+        catch (const std::exception& e) {
+            std::cerr << "Exception: " << e.what() << std::endl;
+            return -1;
+        }
+    }
+}
+
+int main(int argc, char** argv) {
+    if (argc > 1 && std::string(argv[1]) == "--benchmark-index") {
+        // --benchmark-index [gallery size]
+        try {
+            size_t gallery_size = argc > 2 ? parseNumber<size_t>(argv[2], "the gallery size") : 100000;
+            benchmarkDescriptorIndex(std::cout, gallery_size);
+        }
+        catch (const std::exception& e) {
+            std::cerr << "Error benchmarking the descriptor index: " << e.what() << std::endl;
+            return -1;
+        }
+        return 0;
+    }
+    if (argc > 2 && std::string(argv[1]) == "--benchmark-pipeline") {
+        // --benchmark-pipeline <clip> [--format csv|json] [--min-time <seconds>] [--repository-writes on] [detector options]
+        try {
+            PipelineBenchmarkOptions options;
+            options.clip = argv[2];
+            options.json = optionValue(argc, argv, "--format", "csv") == "json";
+            options.min_seconds = numberOption(argc, argv, "--min-time", options.min_seconds);
+            options.repository_writes = optionValue(argc, argv, "--repository-writes", "off") == "on";
+            UserRepository userRepository;
+            FaceRecognizer faceRecognizer(userRepository);
+            faceRecognizer.setDetectorParams(detectorParams(argc, argv));
+            benchmarkPipeline(std::cout, faceRecognizer, userRepository, options);
+        }
+        catch (const std::exception& e) {
+            std::cerr << "Error benchmarking the pipeline: " << e.what() << std::endl;
+            return -1;
+        }
+        return 0;
+    }
+    if (argc > 2 && std::string(argv[1]) == "--benchmark-detectors") {
+        // --benchmark-detectors <clip> [--annotations <csv>] [--min-time <seconds>] [detector options]
+        try {
+            DetectorBenchmarkOptions options;
+            options.clip = argv[2];
+            options.annotations = optionValue(argc, argv, "--annotations", "");
+            options.min_seconds = numberOption(argc, argv, "--min-time", options.min_seconds);
+            options.detector = detectorParams(argc, argv);
+            benchmarkDetectors(std::cout, options);
+        }
+        catch (const std::exception& e) {
+            std::cerr << "Error benchmarking the face detectors: " << e.what() << std::endl;
+            return -1;
+        }
+        return 0;
+    }
+    if (argc > 1 && std::string(argv[1]) == "--compact-gallery") {
+        // --compact-gallery [prototypes per user] [mean|medoids]
+        try {
+            size_t prototypes = argc > 2 ? parseNumber<size_t>(argv[2], "the prototypes per user") : 1;
+            PrototypeMethod method = argc > 3 && std::string(argv[3]) == "mean" ? PrototypeMethod::Mean : PrototypeMethod::Medoids;
+            migrateDescriptorFile();
+            if (!fs::exists(FaceRecognizer::FULL_DESCRIPTOR_STORE_PATH)) {
+                fs::copy_file(FaceRecognizer::DESCRIPTOR_STORE_PATH, FaceRecognizer::FULL_DESCRIPTOR_STORE_PATH);
+            }
+            compactModelFile(FaceRecognizer::FULL_DESCRIPTOR_STORE_PATH, FaceRecognizer::DESCRIPTOR_STORE_PATH, prototypes, method, std::cout);
+        }
+        catch (const std::exception& e) {
+            std::cerr << "Error compacting face descriptors: " << e.what() << std::endl;
+            return -1;
+        }
+        return 0;
+    }
+    if (argc > 1 && std::string(argv[1]) == "--compact-store") {
+        // Drops the rows of removed users from the descriptor files
+        try {
+            for (const char* path : { FaceRecognizer::DESCRIPTOR_STORE_PATH, FaceRecognizer::FULL_DESCRIPTOR_STORE_PATH }) {
+                if (fs::exists(path)) {
+                    DescriptorStore store(path);
+                    size_t before = store.size();
+                    store.compact();
+                    std::cout << path << ": " << before << " -> " << store.size() << " rows" << std::endl;
+                }
+            }
+        }
+        catch (const std::exception& e) {
+            std::cerr << "Error compacting descriptor store: " << e.what() << std::endl;
+            return -1;
+        }
+        return 0;
+    }
+    if (argc > 1 && std::string(argv[1]) == "--batch") {
+        return runBatch(argc, argv);
+    }
 
-int main() {
     //UserRepository userRepository;
 
     //// Инициализация FaceRecognizer
@@ -31,28 +278,45 @@ int main() {
 
         // Инициализация FaceRecognizer
         FaceRecognizer faceRecognizer(userRepository);
+        faceRecognizer.setDetectorParams(detectorParams(argc, argv));
 
-        // Загрузка модели каскадного классификатора для обнаружения лиц
-        cv::CascadeClassifier face_cascade;
-        if (!face_cascade.load("models/haarcascade_frontalface_default.xml")) {
-            std::cerr << "Error loading haarcascade_frontalface_default.xml" << std::endl;
+        DescriptorGallery gallery;
+        if (!loadGallery(argc, argv, gallery)) {
             return -1;
         }
 
-        // Чтение обученных дескрипторов лиц и меток
-        std::vector<matrix<float, 0, 1>> face_descriptors;
-        std::vector<int> labels;
-
-        try {
-            deserialize("models/face_descriptors.dat") >> face_descriptors >> labels;
+        // --camera [name=]<device index|video file|stream url>, repeated for every camera
+        std::vector<CameraManager::Source> sources;
+        for (const std::string& camera : optionValues(argc, argv, "--camera")) {
+            sources.push_back(CameraManager::parseSource(camera));
         }
-        catch (const std::exception& e) {
-            std::cerr << "Error loading face descriptors: " << e.what() << std::endl;
-            return -1;
+        if (sources.empty()) {
+            sources.push_back(CameraManager::parseSource("0"));
         }
+        // --camera-detector <name>=haar|hog|dnn, a camera's own detector backend
+        for (const std::string& choice : optionValues(argc, argv, "--camera-detector")) {
+            auto separator = choice.find('=');
+            auto source = std::find_if(sources.begin(), sources.end(),
+                [&](const CameraManager::Source& source) { return source.name == choice.substr(0, separator); });
+            if (separator == std::string::npos || source == sources.end()) {
+                throw std::invalid_argument("No camera for --camera-detector " + choice);
+            }
+            source->detector = choice.substr(separator + 1);
+        }
+        size_t recognition_workers = numberOption<size_t>(argc, argv, "--recognition-workers", 0);
+
+        // Static frames are skipped and recognition is held to --cpu-budget, a fraction of all cores (0: no limit)
+        RecognitionScheduler::Params scheduling;
+        scheduling.motion_gating = optionValue(argc, argv, "--motion-gate", "on") != "off";
+        scheduling.min_changed_fraction = numberOption(argc, argv, "--motion-threshold", scheduling.min_changed_fraction);
+        scheduling.keepalive = std::chrono::milliseconds(static_cast<long long>(
+            numberOption(argc, argv, "--motion-keepalive", 10.0) * 1000));
+        double cpu_budget = numberOption(argc, argv, "--cpu-budget", 0.0);
 
         // Инициализация CameraManager и запуск распознавания лиц
-        AppUI app(userRepository, faceRecognizer, face_cascade, face_descriptors, labels);
+        SharedGallery shared_gallery(std::move(gallery));
+        std::unique_ptr<MetricsExporter> metrics_exporter = startMetricsExporter(argc, argv);
+        AppUI app(userRepository, faceRecognizer, shared_gallery, std::move(sources), recognition_workers, scheduling, cpu_budget);
         app.start();
 
         auto allUsers = userRepository.getAll();
@@ -0,0 +1,197 @@
+#define _SILENCE_CXX17_CODECVT_HEADER_DEPRECATION_WARNING
+#define _SILENCE_ALL_CXX17_DEPRECATION_WARNINGS
+#define _CRT_SECURE_NO_WARNINGS
+
+#include "EmbeddingCache.hpp"
+
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include <vector>
+#include <dlib/serialize.h>
+
+namespace fs = std::filesystem;
+
+namespace {
+    constexpr uint64_t CACHE_FILE_VERSION = 1;
+    constexpr size_t HASH_CHUNK_BYTES = 1 << 20;
+
+    uint64_t mix(uint64_t hash, uint64_t word) {
+        hash ^= word * 0x9e3779b97f4a7c15ull;
+        hash = (hash << 31) | (hash >> 33);
+        return hash * 0xbf58476d1ce4e5b9ull;
+    }
+}
+
+EmbeddingCache::EmbeddingCache(std::string path) : path(std::move(path)) {
+    if (!fs::exists(this->path)) {
+        return;
+    }
+    try {
+        uint64_t version;
+        std::vector<uint64_t> hashes;
+        std::vector<char> found;
+        std::vector<dlib::matrix<float, 0, 1>> descriptors;
+        std::vector<std::string> photo_paths;
+        std::vector<uint64_t> photo_sizes, photo_hashes;
+        std::vector<int64_t> photo_times;
+        dlib::deserialize(this->path) >> version >> model_hash >> hashes >> found >> descriptors
+            >> photo_paths >> photo_sizes >> photo_times >> photo_hashes;
+        if (version != CACHE_FILE_VERSION || found.size() != hashes.size() || descriptors.size() != hashes.size()
+            || photo_sizes.size() != photo_paths.size() || photo_times.size() != photo_paths.size() || photo_hashes.size() != photo_paths.size()) {
+            throw std::runtime_error("unsupported cache version");
+        }
+        for (size_t i = 0; i < hashes.size(); ++i) {
+            entries[hashes[i]] = Entry{ found[i] != 0, std::move(descriptors[i]) };
+        }
+        for (size_t i = 0; i < photo_paths.size(); ++i) {
+            photos[photo_paths[i]] = PhotoStamp{ photo_sizes[i], photo_times[i], photo_hashes[i] };
+        }
+    }
+    catch (const std::exception& e) {
+        std::cerr << "Error loading " << this->path << ", starting with an empty embedding cache: " << e.what() << std::endl;
+        model_hash = 0;
+        entries.clear();
+        photos.clear();
+    }
+}
+
+void EmbeddingCache::setModelHash(uint64_t model_hash) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (this->model_hash != model_hash) {
+        // Photo hashes do not depend on the models and stay valid
+        entries.clear();
+        used_entries.clear();
+        this->model_hash = model_hash;
+        dirty = true;
+    }
+}
+
+uint64_t EmbeddingCache::photoHash(const std::string& photo) {
+    const uint64_t size = static_cast<uint64_t>(fs::file_size(photo));
+    const int64_t modified = static_cast<int64_t>(fs::last_write_time(photo).time_since_epoch().count());
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        used_photos.insert(photo);
+        auto it = photos.find(photo);
+        if (it != photos.end() && it->second.size == size && it->second.modified == modified) {
+            return it->second.content_hash;
+        }
+    }
+
+    const uint64_t content_hash = hashFile(photo);
+    std::lock_guard<std::mutex> lock(mutex);
+    photos[photo] = PhotoStamp{ size, modified, content_hash };
+    dirty = true;
+    return content_hash;
+}
+
+bool EmbeddingCache::find(uint64_t content_hash, Entry& entry) {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = entries.find(content_hash);
+    if (it == entries.end()) {
+        return false;
+    }
+    used_entries.insert(content_hash);
+    entry = it->second;
+    return true;
+}
+
+void EmbeddingCache::store(uint64_t content_hash, const Entry& entry) {
+    std::lock_guard<std::mutex> lock(mutex);
+    entries[content_hash] = entry;
+    used_entries.insert(content_hash);
+    dirty = true;
+}
+
+void EmbeddingCache::pruneUnused() {
+    std::lock_guard<std::mutex> lock(mutex);
+    for (auto it = entries.begin(); it != entries.end();) {
+        if (used_entries.count(it->first) == 0) {
+            it = entries.erase(it);
+            dirty = true;
+        }
+        else {
+            ++it;
+        }
+    }
+    for (auto it = photos.begin(); it != photos.end();) {
+        if (used_photos.count(it->first) == 0) {
+            it = photos.erase(it);
+            dirty = true;
+        }
+        else {
+            ++it;
+        }
+    }
+    used_entries.clear();
+    used_photos.clear();
+}
+
+void EmbeddingCache::save() {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!dirty) {
+        return;
+    }
+    std::vector<uint64_t> hashes;
+    std::vector<char> found;
+    std::vector<dlib::matrix<float, 0, 1>> descriptors;
+    for (const auto& [hash, entry] : entries) {
+        hashes.push_back(hash);
+        found.push_back(entry.has_face ? 1 : 0);
+        descriptors.push_back(entry.descriptor);
+    }
+    std::vector<std::string> photo_paths;
+    std::vector<uint64_t> photo_sizes, photo_hashes;
+    std::vector<int64_t> photo_times;
+    for (const auto& [photo, stamp] : photos) {
+        photo_paths.push_back(photo);
+        photo_sizes.push_back(stamp.size);
+        photo_times.push_back(stamp.modified);
+        photo_hashes.push_back(stamp.content_hash);
+    }
+
+    const std::string temporary = path + ".tmp";
+    dlib::serialize(temporary) << CACHE_FILE_VERSION << model_hash << hashes << found << descriptors
+        << photo_paths << photo_sizes << photo_times << photo_hashes;
+    fs::rename(temporary, path);
+    dirty = false;
+}
+
+size_t EmbeddingCache::size() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return entries.size();
+}
+
+uint64_t EmbeddingCache::hashFile(const std::string& path) {
+    std::ifstream in(path, std::ios::binary);
+    if (!in) {
+        throw std::runtime_error("Unable to open " + path);
+    }
+    std::vector<char> buffer(HASH_CHUNK_BYTES);
+    uint64_t hash = 0xcbf29ce484222325ull;
+    uint64_t length = 0;
+    while (in) {
+        in.read(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+        const size_t read = static_cast<size_t>(in.gcount());
+        size_t i = 0;
+        for (; i + sizeof(uint64_t) <= read; i += sizeof(uint64_t)) {
+            uint64_t word;
+            std::memcpy(&word, buffer.data() + i, sizeof(word));
+            hash = mix(hash, word);
+        }
+        if (i < read) {
+            uint64_t word = 0;
+            std::memcpy(&word, buffer.data() + i, read - i);
+            hash = mix(hash, word);
+        }
+        length += read;
+    }
+    return mix(hash, length);
+}
+
+uint64_t EmbeddingCache::combine(uint64_t hash, uint64_t value) {
+    return mix(hash, value);
+}
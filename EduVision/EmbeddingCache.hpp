@@ -0,0 +1,58 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <dlib/matrix.h>
+
+// Persistent map from the content hash of an enrollment photo to its face
+// descriptor, or to "no single face found". Entries are only valid for the
+// shape predictor and ResNet they were computed with: the cache is emptied when
+// the model hash passed to setModelHash() differs from the stored one.
+// All members are safe to call from the training workers concurrently.
+class EmbeddingCache {
+public:
+    struct Entry {
+        bool has_face = false;
+        dlib::matrix<float, 0, 1> descriptor;
+    };
+
+    // Loads the cache at `path` when it exists, a damaged file starts an empty cache
+    explicit EmbeddingCache(std::string path);
+
+    void setModelHash(uint64_t model_hash);
+
+    // Content hash of a photo. The file is only read again when its size or modification time changed.
+    uint64_t photoHash(const std::string& photo);
+
+    bool find(uint64_t content_hash, Entry& entry);
+    void store(uint64_t content_hash, const Entry& entry);
+
+    // Drops the entries and photo paths not looked up since the cache was loaded or last pruned
+    void pruneUnused();
+    void save();
+
+    [[nodiscard]] size_t size() const;
+
+    static uint64_t hashFile(const std::string& path);
+    static uint64_t combine(uint64_t hash, uint64_t value);
+
+private:
+    struct PhotoStamp {
+        uint64_t size = 0;
+        int64_t modified = 0;
+        uint64_t content_hash = 0;
+    };
+
+    std::string path;
+    uint64_t model_hash = 0;
+    mutable std::mutex mutex;
+    std::unordered_map<uint64_t, Entry> entries;
+    std::unordered_map<std::string, PhotoStamp> photos;
+    std::unordered_set<uint64_t> used_entries;
+    std::unordered_set<std::string> used_photos;
+    bool dirty = false;
+};
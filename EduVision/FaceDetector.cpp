@@ -0,0 +1,195 @@
+#define _SILENCE_CXX17_CODECVT_HEADER_DEPRECATION_WARNING
+#define _SILENCE_ALL_CXX17_DEPRECATION_WARNINGS
+#define _CRT_SECURE_NO_WARNINGS
+
+#include "FaceDetector.hpp"
+
+#include <algorithm>
+#include <filesystem>
+#include <stdexcept>
+#include <opencv2/imgproc.hpp>
+#include <opencv2/objdetect.hpp>
+#include <dlib/image_processing/frontal_face_detector.h>
+#include <dlib/opencv/cv_image.h>
+
+// cv::FaceDetectorYN came with OpenCV 4.5.4
+#if CV_VERSION_MAJOR > 4 || (CV_VERSION_MAJOR == 4 && (CV_VERSION_MINOR > 5 || (CV_VERSION_MINOR == 5 && CV_VERSION_REVISION >= 4)))
+#define EDUVISION_HAS_YUNET 1
+#endif
+
+namespace {
+    class HaarFaceDetector : public FaceDetector {
+    public:
+        explicit HaarFaceDetector(Params params) : FaceDetector(std::move(params)) {
+            if (!cascade.load(this->params.cascade_path)) {
+                throw std::runtime_error("Error loading " + this->params.cascade_path);
+            }
+        }
+
+    protected:
+        int nativeMinFace() const override { return MIN_WINDOW; }
+
+        std::vector<cv::Rect> detectScaled(const cv::Mat& image) override {
+            cv::cvtColor(image, gray, cv::COLOR_BGR2GRAY);
+            std::vector<cv::Rect> faces;
+            cascade.detectMultiScale(gray, faces, params.pyramid_step, 5, 0, cv::Size(MIN_WINDOW, MIN_WINDOW));
+            return faces;
+        }
+
+    private:
+        // The window the cascade used to be run with on the half-size frame, so the default
+        // min_face_size of 60 keeps the detections of before
+        static constexpr int MIN_WINDOW = 30;
+
+        cv::CascadeClassifier cascade;
+        cv::Mat gray;
+    };
+
+    class HogFaceDetector : public FaceDetector {
+    public:
+        explicit HogFaceDetector(Params params)
+            : FaceDetector(std::move(params)), detector(dlib::get_frontal_face_detector()) {}
+
+    protected:
+        // dlib's frontal face detector scans an 80x80 window
+        int nativeMinFace() const override { return 80; }
+
+        std::vector<cv::Rect> detectScaled(const cv::Mat& image) override {
+            dlib::cv_image<dlib::bgr_pixel> cimg(image);
+            std::vector<cv::Rect> faces;
+            for (const dlib::rectangle& face : detector(cimg)) {
+                faces.emplace_back(static_cast<int>(face.left()), static_cast<int>(face.top()),
+                    static_cast<int>(face.width()), static_cast<int>(face.height()));
+            }
+            return faces;
+        }
+
+    private:
+        dlib::frontal_face_detector detector;
+    };
+
+#if defined(EDUVISION_HAS_YUNET)
+    // YuNet from the OpenCV model zoo; face_detection_yunet_2023mar.onnx needs OpenCV 4.8
+    class DnnFaceDetector : public FaceDetector {
+    public:
+        explicit DnnFaceDetector(Params params) : FaceDetector(std::move(params)) {
+            if (!std::filesystem::exists(this->params.dnn_model_path)) {
+                throw std::runtime_error("Error loading " + this->params.dnn_model_path);
+            }
+            network = cv::FaceDetectorYN::create(this->params.dnn_model_path, "", input_size, this->params.score_threshold, 0.3f, 5000);
+        }
+
+    protected:
+        // Faces down to about 10 pixels are found, with a margin for reliability
+        int nativeMinFace() const override { return 16; }
+
+        std::vector<cv::Rect> detectScaled(const cv::Mat& image) override {
+            if (image.size() != input_size) {
+                input_size = image.size();
+                network->setInputSize(input_size);
+            }
+            // One row per face: box, five landmarks and the score
+            cv::Mat detections;
+            network->detect(image, detections);
+            std::vector<cv::Rect> faces;
+            for (int i = 0; i < detections.rows; ++i) {
+                const float* row = detections.ptr<float>(i);
+                faces.emplace_back(cvRound(row[0]), cvRound(row[1]), cvRound(row[2]), cvRound(row[3]));
+            }
+            return faces;
+        }
+
+    private:
+        cv::Ptr<cv::FaceDetectorYN> network;
+        cv::Size input_size{ 320, 320 };
+    };
+#endif
+}
+
+std::unique_ptr<FaceDetector> FaceDetector::create(const Params& params) {
+    if (params.min_face_size <= 0) {
+        throw std::invalid_argument("The minimum face size must be positive");
+    }
+    if (params.pyramid_step <= 1.0) {
+        throw std::invalid_argument("The pyramid step must be greater than 1");
+    }
+    switch (params.backend) {
+    case Backend::Haar:
+        return std::make_unique<HaarFaceDetector>(params);
+    case Backend::Hog:
+        return std::make_unique<HogFaceDetector>(params);
+    case Backend::Dnn:
+#if defined(EDUVISION_HAS_YUNET)
+        return std::make_unique<DnnFaceDetector>(params);
+#else
+        throw std::runtime_error("The dnn face detector needs OpenCV 4.5.4 or newer");
+#endif
+    }
+    throw std::invalid_argument("Unknown face detector backend");
+}
+
+FaceDetector::Backend FaceDetector::parseBackend(const std::string& name) {
+    for (Backend backend : { Backend::Haar, Backend::Hog, Backend::Dnn }) {
+        if (name == backendName(backend)) {
+            return backend;
+        }
+    }
+    throw std::invalid_argument("Unknown face detector " + name + ", expected haar, hog or dnn");
+}
+
+const char* FaceDetector::backendName(Backend backend) {
+    switch (backend) {
+    case Backend::Haar:
+        return "haar";
+    case Backend::Hog:
+        return "hog";
+    case Backend::Dnn:
+        return "dnn";
+    }
+    return "unknown";
+}
+
+std::vector<cv::Rect> FaceDetector::detect(const cv::Mat& frame) {
+    if (frame.empty()) {
+        return {};
+    }
+    // Scaled so the smallest face of interest is as large as the backend's smallest
+    const double scale = std::min(MAX_UPSCALE, static_cast<double>(nativeMinFace()) / params.min_face_size);
+    const cv::Size size(std::max(1, cvRound(frame.cols * scale)), std::max(1, cvRound(frame.rows * scale)));
+    const cv::Mat* image = &frame;
+    if (size != frame.size()) {
+        cv::resize(frame, scaled, size);
+        image = &scaled;
+    }
+
+    const double scale_x = static_cast<double>(frame.cols) / image->cols;
+    const double scale_y = static_cast<double>(frame.rows) / image->rows;
+    const cv::Rect bounds(0, 0, frame.cols, frame.rows);
+    std::vector<cv::Rect> faces;
+    for (const cv::Rect& face : detectScaled(*image)) {
+        const cv::Rect full(cvRound(face.x * scale_x), cvRound(face.y * scale_y),
+            cvRound(face.width * scale_x), cvRound(face.height * scale_y));
+        const cv::Rect clipped = full & bounds;
+        if (!clipped.empty()) {
+            faces.push_back(clipped);
+        }
+    }
+    return faces;
+}
+
+std::vector<cv::Rect> FaceDetector::detect(const cv::Mat& frame, const std::vector<cv::Rect>& regions) {
+    if (regions.empty()) {
+        return detect(frame);
+    }
+    std::vector<cv::Rect> faces;
+    for (const cv::Rect& region : regions) {
+        const cv::Rect clipped = region & cv::Rect(0, 0, frame.cols, frame.rows);
+        if (clipped.empty()) {
+            continue;
+        }
+        for (const cv::Rect& face : detect(frame(clipped))) {
+            faces.push_back(face + clipped.tl());
+        }
+    }
+    return faces;
+}
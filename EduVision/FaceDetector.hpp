@@ -0,0 +1,61 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+#include <opencv2/core.hpp>
+
+// Finds the faces of a BGR frame. Backends: OpenCV's Haar cascade, dlib's HOG detector
+// and OpenCV's DNN face detector YuNet. Every backend has a smallest face it finds in
+// the image it is given; the frame is scaled so a face of `min_face_size` pixels meets
+// that size, downscaled when the faces of interest are large and upscaled (at most
+// MAX_UPSCALE) for small, back-row faces. Each backend then runs on its own image pyramid:
+// the cascade on levels `pyramid_step` apart, the HOG detector on dlib's 5/6 pyramid and
+// YuNet on the feature pyramid of the network. An instance keeps per-call state, so every
+// thread or camera has its own.
+class FaceDetector {
+public:
+    enum class Backend { Haar, Hog, Dnn };
+
+    static constexpr const char* CASCADE_PATH = "models/haarcascade_frontalface_default.xml";
+    static constexpr const char* YUNET_PATH = "models/face_detection_yunet_2023mar.onnx";
+    static constexpr double MAX_UPSCALE = 2.0;
+
+    struct Params {
+        Backend backend = Backend::Haar;
+        int min_face_size = 60;        // full-size pixels, smaller faces are not looked for
+        double pyramid_step = 1.1;     // size ratio of neighbouring levels of the cascade's pyramid
+        float score_threshold = 0.7f;  // DNN confidence a face needs
+        std::string cascade_path = CASCADE_PATH;
+        std::string dnn_model_path = YUNET_PATH;
+    };
+
+    // Loads the backend's model, throws when it can not be read
+    static std::unique_ptr<FaceDetector> create(const Params& params);
+
+    // "haar", "hog" or "dnn"
+    static Backend parseBackend(const std::string& name);
+    static const char* backendName(Backend backend);
+
+    virtual ~FaceDetector() = default;
+
+    // Boxes in frame coordinates, clipped to the frame
+    std::vector<cv::Rect> detect(const cv::Mat& frame);
+    // Detection inside non-overlapping regions of the frame only, all of it when `regions` is empty
+    std::vector<cv::Rect> detect(const cv::Mat& frame, const std::vector<cv::Rect>& regions);
+
+    [[nodiscard]] const Params& getParams() const { return params; }
+
+protected:
+    explicit FaceDetector(Params params) : params(std::move(params)) {}
+
+    // Smallest face in pixels the backend finds in the image it is given
+    [[nodiscard]] virtual int nativeMinFace() const = 0;
+    // Faces of the scaled BGR image, in its coordinates
+    virtual std::vector<cv::Rect> detectScaled(const cv::Mat& image) = 0;
+
+    Params params;
+
+private:
+    cv::Mat scaled;  // reused between frames
+};
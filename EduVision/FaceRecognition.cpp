@@ -6,11 +6,23 @@
 #include "User.hpp"
 
 
+namespace {
+    // Face chip on its way from the detection workers to the ResNet. Photos found in the
+    // embedding cache skip the ResNet and arrive with `descriptor` already filled in.
+    struct FaceChip {
+        size_t photo;
+        int label;
+        uint64_t content_hash;
+        matrix<rgb_pixel> chip;
+        matrix<float, 0, 1> descriptor;
+    };
+}
+
 dlib::frontal_face_detector FaceRecognizer::detector = dlib::get_frontal_face_detector();
 
 FaceRecognizer::FaceRecognizer(UserRepository& userRepository) : userRepository(userRepository) {
     try {
-        dlib::deserialize("models/shape_predictor_68_face_landmarks.dat") >> sp;
+        dlib::deserialize(SHAPE_PREDICTOR_PATH) >> sp;
     }
     catch (const std::exception& e) {
         std::cerr << "Error loading shape_predictor_68_face_landmarks.dat: " << e.what() << std::endl;
@@ -18,7 +30,7 @@ FaceRecognizer::FaceRecognizer(UserRepository& userRepository) : userRepository(
     }
 
     try {
-        dlib::deserialize("models/dlib_face_recognition_resnet_model_v1.dat") >> net;
+        dlib::deserialize(RESNET_PATH) >> net;
     }
     catch (const std::exception& e) {
         std::cerr << "Error loading dlib_face_recognition_resnet_model_v1.dat: " << e.what() << std::endl;
@@ -26,194 +38,427 @@ FaceRecognizer::FaceRecognizer(UserRepository& userRepository) : userRepository(
     }
 }
 
-void FaceRecognizer::trainModel() {
-    std::vector<matrix<rgb_pixel>> faces;
-    std::vector<int> labels;
+void FaceRecognizer::prepareEmbeddingCache() {
+    // Hashing the models reads ~120 MB, so only enrollment pays for it, once
+    std::call_once(model_hash_once, [this] {
+        // Cached descriptors are only valid for these exact models and chip geometry
+        uint64_t model_hash = EmbeddingCache::hashFile(SHAPE_PREDICTOR_PATH);
+        model_hash = EmbeddingCache::combine(model_hash, EmbeddingCache::hashFile(RESNET_PATH));
+        model_hash = EmbeddingCache::combine(model_hash, FACE_CHIP_SIZE);
+        model_hash = EmbeddingCache::combine(model_hash, static_cast<uint64_t>(FACE_CHIP_PADDING * 1000));
+        embedding_cache.setModelHash(model_hash);
+    });
+}
 
-    //   
-    std::vector<User> users = userRepository.getAll();
 
-    for (const User& user : users) {
-        int label = user.getId();
-        std::string user_data_path = "person_data/" + std::to_string(label) + "/";
+void FaceRecognizer::listPhotos(int userId, std::vector<std::pair<std::string, int>>& photos) const {
+    std::string user_data_path = "person_data/" + std::to_string(userId) + "/";
+
+    //      
+    for (const auto& file : fs::directory_iterator(user_data_path)) {
+        if (file.path().extension() == ".jpg" || file.path().extension() == ".png") {
+            photos.emplace_back(file.path().string(), userId);
+        }
+    }
+}
 
-        //      
-        for (const auto& file : fs::directory_iterator(user_data_path)) {
-            if (file.path().extension() == ".jpg" || file.path().extension() == ".png") {
-                matrix<rgb_pixel> img;
-                load_image(img, file.path().string());
+void FaceRecognizer::embedPhotos(const std::vector<std::pair<std::string, int>>& photos,
+    std::vector<matrix<float, 0, 1>>& face_descriptors, std::vector<int>& labels) {
+    prepareEmbeddingCache();
+    size_t threads = training_threads > 0 ? training_threads : std::thread::hardware_concurrency();
+    threads = std::max<size_t>(1, std::min(threads, photos.size()));
 
-                std::vector<rectangle> dets = detector(img);
-                if (dets.size() == 1) {
+    // Decoding, detection and landmarking run on the workers, the ResNet runs on this thread.
+    // At most 2 batches of chips wait in the queue, so memory does not depend on the roster size.
+    BoundedQueue<FaceChip> chips(2 * max_batch_size);
+    std::atomic<size_t> next_photo{ 0 };
+    std::atomic<size_t> running{ threads };
+
+    std::vector<std::thread> workers;
+    for (size_t t = 0; t < threads; ++t) {
+        workers.emplace_back([&] {
+            // object_detector keeps scratch buffers, so every worker needs its own copy
+            dlib::frontal_face_detector worker_detector = detector;
+            for (size_t i = next_photo++; i < photos.size(); i = next_photo++) {
+                try {
+                    FaceChip face{ i, photos[i].second, embedding_cache.photoHash(photos[i].first), {}, {} };
+                    EmbeddingCache::Entry cached;
+                    if (embedding_cache.find(face.content_hash, cached)) {
+                        face.descriptor = std::move(cached.descriptor);
+                        if (cached.has_face && !chips.push(std::move(face))) {
+                            break;
+                        }
+                        continue;
+                    }
+
+                    matrix<rgb_pixel> img;
+                    load_image(img, photos[i].first);
+
+                    std::vector<rectangle> dets = worker_detector(img);
+                    if (dets.size() != 1) {
+                        embedding_cache.store(face.content_hash, EmbeddingCache::Entry{});
+                        continue;
+                    }
                     auto shape = sp(img, dets[0]);
-                    matrix<rgb_pixel> face_chip;
-                    extract_image_chip(img, get_face_chip_details(shape, 150, 0.25), face_chip);
-                    faces.push_back(std::move(face_chip));
-                    labels.push_back(label);
+                    extract_image_chip(img, get_face_chip_details(shape, FACE_CHIP_SIZE, FACE_CHIP_PADDING), face.chip);
+                    if (!chips.push(std::move(face))) {
+                        break;
+                    }
+                }
+                catch (const std::exception& e) {
+                    std::cerr << "Error loading " << photos[i].first << ": " << e.what() << std::endl;
                 }
             }
+            if (--running == 0) {
+                chips.close();
+            }
+        });
+    }
+
+    std::vector<std::pair<size_t, size_t>> order;
+    std::vector<matrix<float, 0, 1>> embedded;
+    std::vector<int> embedded_labels;
+    try {
+        std::vector<matrix<rgb_pixel>> batch;
+        std::vector<FaceChip> batch_faces;
+        auto flush = [&] {
+            std::vector<matrix<float, 0, 1>> descriptors = computeDescriptors(batch);
+            for (size_t i = 0; i < descriptors.size(); ++i) {
+                embedding_cache.store(batch_faces[i].content_hash, EmbeddingCache::Entry{ true, descriptors[i] });
+                order.emplace_back(batch_faces[i].photo, embedded.size());
+                embedded.push_back(std::move(descriptors[i]));
+                embedded_labels.push_back(batch_faces[i].label);
+            }
+            batch.clear();
+            batch_faces.clear();
+        };
+        while (std::optional<FaceChip> face = chips.pop()) {
+            Metrics::global().set(Metrics::Gauge::EmbeddingQueueDepth, static_cast<int64_t>(chips.size()));
+            if (face->descriptor.size() != 0) {
+                order.emplace_back(face->photo, embedded.size());
+                embedded.push_back(std::move(face->descriptor));
+                embedded_labels.push_back(face->label);
+                continue;
+            }
+            batch.push_back(std::move(face->chip));
+            batch_faces.push_back(std::move(*face));
+            if (batch.size() == max_batch_size) {
+                flush();
+            }
         }
+        flush();
+        Metrics::global().set(Metrics::Gauge::EmbeddingQueueDepth, 0);
+    }
+    catch (...) {
+        chips.close();
+        for (std::thread& worker : workers) {
+            worker.join();
+        }
+        throw;
+    }
+    for (std::thread& worker : workers) {
+        worker.join();
     }
 
-    std::vector<matrix<float, 0, 1>> face_descriptors = net(faces);
-    serialize("models/face_descriptors.dat") << face_descriptors << labels;
+    // Chips arrive in completion order, sorting by photo keeps the saved gallery reproducible
+    std::sort(order.begin(), order.end());
+    face_descriptors.reserve(face_descriptors.size() + order.size());
+    labels.reserve(labels.size() + order.size());
+    for (const auto& [photo, row] : order) {
+        face_descriptors.push_back(std::move(embedded[row]));
+        labels.push_back(embedded_labels[row]);
+    }
 }
 
-void FaceRecognizer::addUserToModel(int userId) {
-    std::vector<matrix<rgb_pixel>> new_faces;
-    std::vector<int> new_labels;
-    std::string user_data_path = "person_data/" + std::to_string(userId) + "/";
+void FaceRecognizer::trainModel() {
+    std::vector<std::pair<std::string, int>> photos;
 
-    //      
-    for (const auto& file : fs::directory_iterator(user_data_path)) {
-        if (file.path().extension() == ".jpg" || file.path().extension() == ".png") {
-            matrix<rgb_pixel> img;
-            load_image(img, file.path().string());
-
-            std::vector<rectangle> dets = detector(img);
-            if (dets.size() == 1) {
-                auto shape = sp(img, dets[0]);
-                matrix<rgb_pixel> face_chip;
-                extract_image_chip(img, get_face_chip_details(shape, 150, 0.25), face_chip);
-                new_faces.push_back(std::move(face_chip));
-                new_labels.push_back(userId);
-            }
-        }
+    //   
+    std::vector<User> users = userRepository.getAll();
+    for (const User& user : users) {
+        listPhotos(user.getId(), photos);
     }
 
-    //       
     std::vector<matrix<float, 0, 1>> face_descriptors;
     std::vector<int> labels;
+    embedPhotos(photos, face_descriptors, labels);
+    saveModel(face_descriptors, labels);
+
+    // Photos that were deleted or replaced since the last full retrain leave the cache
+    embedding_cache.pruneUnused();
+    saveEmbeddingCache();
+}
+
+void FaceRecognizer::addUserToModel(int userId, SharedGallery& gallery) {
+    std::vector<matrix<float, 0, 1>> gallery_rows;
+    std::vector<int> gallery_labels;
+    releaseStoreMapping(gallery);
+    appendUserToStores(userId, gallery_rows, gallery_labels);
+
+    // Recognition keeps matching against the previous snapshot until this one is published
+    gallery.update([&](DescriptorGallery& next) {
+        next.reserve(next.size() + gallery_rows.size());
+        for (size_t i = 0; i < gallery_rows.size(); ++i) {
+            next.add(gallery_rows[i], gallery_labels[i]);
+        }
+        next.restoreLabel(userId);
+    });
     try {
-        dlib::deserialize("models/face_descriptors.dat") >> face_descriptors >> labels;
+        gallery.load()->saveIndex(INDEX_PATH);
     }
     catch (const std::exception& e) {
-        std::cerr << "Error loading face_descriptors.dat: " << e.what() << std::endl;
+        std::cerr << "Error saving " << INDEX_PATH << ": " << e.what() << std::endl;
     }
+}
+
+void FaceRecognizer::appendUserToStores(int userId, std::vector<matrix<float, 0, 1>>& gallery_rows, std::vector<int>& gallery_labels) {
+    std::vector<std::pair<std::string, int>> photos;
+    listPhotos(userId, photos);
 
     //     
-    std::vector<matrix<float, 0, 1>> new_face_descriptors = net(new_faces);
+    std::vector<matrix<float, 0, 1>> new_face_descriptors;
+    std::vector<int> new_labels;
+    embedPhotos(photos, new_face_descriptors, new_labels);
+    saveEmbeddingCache();
+
+    //      ,    .
+    // The photos are all of the user's, so rows of an earlier enrollment are replaced, not kept next to them.
+    // --compact-gallery rebuilds the main store from the full one, which therefore gets every enrollment too.
+    if (prototypes_per_user > 0 || fs::exists(FULL_DESCRIPTOR_STORE_PATH)) {
+        DescriptorStore(FULL_DESCRIPTOR_STORE_PATH).replaceLabel(userId, new_face_descriptors);
+    }
+    if (prototypes_per_user == 0) {
+        DescriptorStore(DESCRIPTOR_STORE_PATH).replaceLabel(userId, new_face_descriptors);
+        gallery_rows = std::move(new_face_descriptors);
+        gallery_labels = std::move(new_labels);
+        return;
+    }
+
+    // Prototypes are per user and computed from all of the user's photos, so they are the rows a full rebuild gives
+    compactDescriptors(new_face_descriptors, new_labels, prototypes_per_user, prototype_method, gallery_rows, gallery_labels);
+    DescriptorStore(DESCRIPTOR_STORE_PATH).replaceLabel(userId, gallery_rows);
+}
+
+void FaceRecognizer::releaseStoreMapping(SharedGallery& gallery) {
+    std::weak_ptr<const void> mapping = gallery.load()->getMapping();
+    if (mapping.expired()) {
+        return;
+    }
+    gallery.update([](DescriptorGallery& next) {
+        next.detachMapping();
+    });
+    // Recognition holds a snapshot for one frame at most
+    while (!mapping.expired()) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+}
+
+void FaceRecognizer::removeUserFromModel(int userId, SharedGallery& gallery) {
+    releaseStoreMapping(gallery);
+    DescriptorStore(DESCRIPTOR_STORE_PATH).removeLabel(userId);
+    if (fs::exists(FULL_DESCRIPTOR_STORE_PATH)) {
+        DescriptorStore(FULL_DESCRIPTOR_STORE_PATH).removeLabel(userId);
+    }
+    gallery.update([userId](DescriptorGallery& next) {
+        next.removeLabel(userId);
+    });
+}
+
+void FaceRecognizer::setPrototypesPerUser(size_t count, PrototypeMethod method) {
+    prototypes_per_user = count;
+    prototype_method = method;
+}
+
+void FaceRecognizer::saveModel(const std::vector<matrix<float, 0, 1>>& face_descriptors, const std::vector<int>& labels) {
+    if (prototypes_per_user == 0) {
+        DescriptorStore::write(DESCRIPTOR_STORE_PATH, face_descriptors, labels);
+        // A full store left by --compact-gallery would otherwise hold the roster of before the retrain
+        if (fs::exists(FULL_DESCRIPTOR_STORE_PATH)) {
+            DescriptorStore::write(FULL_DESCRIPTOR_STORE_PATH, face_descriptors, labels);
+        }
+        return;
+    }
+    DescriptorStore::write(FULL_DESCRIPTOR_STORE_PATH, face_descriptors, labels);
+
+    std::vector<matrix<float, 0, 1>> prototypes;
+    std::vector<int> prototype_labels;
+    compactDescriptors(face_descriptors, labels, prototypes_per_user, prototype_method, prototypes, prototype_labels);
+    DescriptorStore::write(DESCRIPTOR_STORE_PATH, prototypes, prototype_labels);
+}
+
+void FaceRecognizer::saveEmbeddingCache() {
+    try {
+        embedding_cache.save();
+    }
+    catch (const std::exception& e) {
+        std::cerr << "Error saving the embedding cache: " << e.what() << std::endl;
+    }
+}
 
-    //     
-    face_descriptors.insert(face_descriptors.end(), new_face_descriptors.begin(), new_face_descriptors.end());
-    labels.insert(labels.end(), new_labels.begin(), new_labels.end());
+void FaceRecognizer::setTrackerParams(const FaceTracker::Params& params) {
+    tracker_params = params;
+}
 
-    //       
-    serialize("models/face_descriptors.dat") << face_descriptors << labels;
+FaceTracker::Params FaceRecognizer::getTrackerParams() const {
+    return tracker_params;
+}
+
+void FaceRecognizer::setDetectorParams(const FaceDetector::Params& params) {
+    detector_params = params;
+}
+
+FaceDetector::Params FaceRecognizer::getDetectorParams() const {
+    return detector_params;
+}
+
+void FaceRecognizer::setTrainingThreads(size_t threads) {
+    training_threads = threads;
+}
+
+void FaceRecognizer::setMaxBatchSize(size_t batch_size) {
+    max_batch_size = std::max<size_t>(batch_size, 1);
+}
+
+std::vector<matrix<float, 0, 1>> FaceRecognizer::computeDescriptors(const std::vector<matrix<rgb_pixel>>& face_chips) {
+    std::lock_guard<std::mutex> lock(network_mutex);
+    return computeDescriptors(net, face_chips);
+}
+
+std::vector<matrix<float, 0, 1>> FaceRecognizer::computeDescriptors(anet_type& network, const std::vector<matrix<rgb_pixel>>& face_chips) const {
+    if (face_chips.empty()) {
+        return {};
+    }
+    return network(face_chips, max_batch_size);
 }
 
 void FaceRecognizer::markAttendance(int userId) {
-    auto user = userRepository.findById(userId);
+    auto user = userRepository.findSummary(userId);
     if (user) {
-        auto attendance = user->getAttendance();
-        if (!attendance.empty()) {
-            auto last_attendance = attendance.back();
+        if (auto last_attendance = user->last_attendance) {
             auto now = std::chrono::system_clock::to_time_t(std::chrono::system_clock::now());
-            if (now - last_attendance < 1800) {
+            if (now - *last_attendance < 1800) {
                 return;  //      30  ,  
             }
         }
-        user->markAttended();
-        userRepository.update(*user);
-    }
-}
-
-void FaceRecognizer::recognizeFaces(cv::CascadeClassifier& face_cascade, std::vector<dlib::matrix<float, 0, 1>>& face_descriptors, std::vector<int>& labels, std::atomic<bool>& stop_flag) {
-    while (!stop_flag) {
-        std::unique_lock<std::mutex> lock(frame_mutex);
-        frame_cond.wait(lock, [&] { return new_frame_ready || stop_flag; });
-
-        if (stop_flag) break;
-
-        cv::Mat frame = current_frame.clone();
-        new_frame_ready = false;
-        lock.unlock();
-
-        cv::Mat small_frame;
-        cv::resize(frame, small_frame, cv::Size(frame.cols / 2, frame.rows / 2)); // Reduce image size for faster processing
-
-        std::vector<cv::Rect> faces;
-        cv::Mat gray;
-        cv::cvtColor(small_frame, gray, cv::COLOR_BGR2GRAY);
-        face_cascade.detectMultiScale(gray, faces, 1.1, 5, 0, cv::Size(30, 30));
-
-        for (auto& face : faces) {
-            cv::Rect scaled_face(face.x * 2, face.y * 2, face.width * 2, face.height * 2); // Scale back to original size
-            cv::Mat face_roi = frame(scaled_face);
-            dlib::cv_image<dlib::bgr_pixel> cimg(face_roi);
-            auto shape = sp(cimg, dlib::rectangle(0, 0, face_roi.cols, face_roi.rows));
-            dlib::matrix<dlib::rgb_pixel> face_chip;
-            dlib::extract_image_chip(cimg, dlib::get_face_chip_details(shape, 150, 0.25), face_chip);
-            dlib::matrix<float, 0, 1> face_descriptor = net(face_chip);
-
-            float min_distance = 0.6;
-            int label = -1;
-            for (size_t j = 0; j < face_descriptors.size(); ++j) {
-                float distance = dlib::length(face_descriptor - face_descriptors[j]);
-                if (distance < min_distance) {
-                    min_distance = distance;
-                    label = labels[j];
-                }
-            }
+        userRepository.markAttended(userId, std::chrono::system_clock::to_time_t(std::chrono::system_clock::now()));
+    }
+}
+
+FaceRecognizer::Worker FaceRecognizer::makeWorker() const {
+    std::lock_guard<std::mutex> lock(network_mutex);
+    return Worker{ net, FaceDetector::create(detector_params) };
+}
+
+std::vector<std::string> FaceRecognizer::getUpdatedUsers() const {
+    std::lock_guard<std::mutex> lock(attendance_mutex);
+    return updated_users;
+}
+
+int FaceRecognizer::attendanceTrack(int label, int track_id, std::chrono::system_clock::time_point timestamp) {
+    auto it = track_owners.find(label);
+    if (it == track_owners.end() || it->second.track_id == track_id
+        || timestamp - it->second.last_seen > CROSS_CAMERA_WINDOW || it->second.last_seen - timestamp > CROSS_CAMERA_WINDOW) {
+        track_owners[label] = TrackOwner{ track_id, timestamp };
+        return track_id;
+    }
+    // The same student is already followed by a track of another camera, the vote goes to that track
+    it->second.last_seen = std::max(it->second.last_seen, timestamp);
+    return it->second.track_id;
+}
+
+void FaceRecognizer::endTracks(const std::vector<int>& track_ids) {
+    if (track_ids.empty()) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(attendance_mutex);
+    for (int track_id : track_ids) {
+        userRepository.endTrack(track_id);
+        for (auto it = track_owners.begin(); it != track_owners.end();) {
+            it = it->second.track_id == track_id ? track_owners.erase(it) : std::next(it);
+        }
+    }
+}
+
+void FaceRecognizer::finishTracks(FaceTracker& face_tracker) {
+    std::vector<int> track_ids = face_tracker.takeEndedTracks();
+    for (const FaceTracker::Track& track : face_tracker.getTracks()) {
+        track_ids.push_back(track.id);
+    }
+    endTracks(track_ids);
+}
+
+void FaceRecognizer::processFrame(const cv::Mat& frame, FaceTracker& face_tracker, Worker& worker, SharedGallery& gallery,
+    std::chrono::system_clock::time_point timestamp, const std::string& camera, const std::vector<cv::Rect>& regions,
+    FaceDetector* detector) {
+    Metrics& metrics = Metrics::global();
+    Metrics::Timer frame_timer(Metrics::Stage::Frame);
+    metrics.add(Metrics::Counter::FramesProcessed);
+
+    Metrics::Timer detection_timer(Metrics::Stage::Detection);
+    std::vector<cv::Rect> scaled_faces = (detector != nullptr ? *detector : *worker.detector).detect(frame, regions);
+    detection_timer.stop();
+    std::vector<int> face_tracks = face_tracker.update(scaled_faces, frame);
+    endTracks(face_tracker.takeEndedTracks());
 
-            int x1 = scaled_face.x;
-            int y1 = scaled_face.y;
+    // Only tracks that are new, unsure or due for a refresh are embedded; their faces go through the ResNet as one batch
+    std::vector<size_t> embedded_faces;
+    std::vector<dlib::matrix<dlib::rgb_pixel>> face_chips;
+    for (size_t i = 0; i < scaled_faces.size(); ++i) {
+        if (!face_tracker.needsEmbedding(face_tracks[i])) {
+            continue;
+        }
+        Metrics::Timer landmarks_timer(Metrics::Stage::Landmarks);
+        cv::Mat face_roi = frame(scaled_faces[i]);
+        dlib::cv_image<dlib::bgr_pixel> cimg(face_roi);
+        auto shape = sp(cimg, dlib::rectangle(0, 0, face_roi.cols, face_roi.rows));
+        dlib::matrix<dlib::rgb_pixel> face_chip;
+        dlib::extract_image_chip(cimg, dlib::get_face_chip_details(shape, FACE_CHIP_SIZE, FACE_CHIP_PADDING), face_chip);
+        embedded_faces.push_back(i);
+        face_chips.push_back(std::move(face_chip));
+    }
+
+    if (face_chips.empty()) {
+        return;
+    }
+    metrics.add(Metrics::Counter::FacesEmbedded, face_chips.size());
 
-            if (label != -1) {
-                if (userRepository.recognize(label)) {
-                    auto user = *userRepository.findById(label);
-                    std::string upd_user_info = user.getName() + " " + user.getSurname() + " " + user.getGroup() + " was recognized";
+    Metrics::Timer embedding_timer(Metrics::Stage::Embedding);
+    std::vector<dlib::matrix<float, 0, 1>> frame_descriptors = computeDescriptors(worker.net, face_chips);
+    embedding_timer.stop();
+
+    Metrics::Timer matching_timer(Metrics::Stage::Matching);
+    std::shared_ptr<const DescriptorGallery> snapshot = gallery.load();
+    std::vector<DescriptorGallery::Match> matches = snapshot->findNearest(frame_descriptors, 0.6f);
+    matching_timer.stop();
+
+    for (size_t i = 0; i < matches.size(); ++i) {
+        const cv::Rect& scaled_face = scaled_faces[embedded_faces[i]];
+        int track_id = face_tracks[embedded_faces[i]];
+        int label = matches[i].label;
+        face_tracker.assignIdentity(track_id, label);
+
+        int x1 = scaled_face.x;
+        int y1 = scaled_face.y;
+
+        if (label != -1) {
+            // Workers of all cameras share the repository and the votes
+            Metrics::Timer attendance_timer(Metrics::Stage::Attendance);
+            std::lock_guard<std::mutex> lock(attendance_mutex);
+            if (userRepository.recognize(label, attendanceTrack(label, track_id, timestamp), timestamp, camera)) {
+                metrics.add(Metrics::Counter::Recognitions);
+                // The user may have been removed since recognize() looked them up
+                if (auto user = userRepository.findSummary(label)) {
+                    std::string upd_user_info = user->name + " " + user->surname + " " + user->group + " was recognized";
                     updated_users.push_back(upd_user_info);
                 }
             }
+        }
 
-            {
-                /*std::lock_guard<std::mutex> lock(frame_mutex);
-                cv::rectangle(current_frame, scaled_face, cv::Scalar(0, 255, 0), 2);
-                cv::putText(current_frame, name, cv::Point(x1, y1 - 10), cv::FONT_HERSHEY_SIMPLEX, 0.9, cv::Scalar(0, 255, 0), 2);
-                std::cout << name << std::endl;*/
-            }
+        {
+            /*std::lock_guard<std::mutex> lock(frame_mutex);
+            cv::rectangle(current_frame, scaled_face, cv::Scalar(0, 255, 0), 2);
+            cv::putText(current_frame, name, cv::Point(x1, y1 - 10), cv::FONT_HERSHEY_SIMPLEX, 0.9, cv::Scalar(0, 255, 0), 2);
+            std::cout << name << std::endl;*/
         }
     }
 }
-
-//CameraManager::CameraManager(FaceRecognizer& recognizer, cv::CascadeClassifier& face_cascade, std::vector<matrix<float, 0, 1>>& face_descriptors, std::vector<int>& labels, std::vector<std::string>& names)
-//    : recognizer(recognizer), face_cascade(face_cascade), face_descriptors(face_descriptors), labels(labels), names(names) {
-//}
-//
-//void CameraManager::start() {
-//    cv::VideoCapture cap(0, cv::CAP_DSHOW);
-//    if (!cap.isOpened()) {
-//        throw std::runtime_error("Error opening video stream");
-//    }
-//
-//    std::thread recognition_thread(&FaceRecognizer::recognizeFaces, &recognizer, std::ref(face_cascade), std::ref(face_descriptors), std::ref(labels), std::ref(names));
-//
-//    while (true) {
-//        {
-//            std::lock_guard<std::mutex> lock(recognizer.frame_mutex);
-//            cap >> recognizer.current_frame;
-//            if (recognizer.current_frame.empty()) {
-//                break;
-//            }
-//        }
-//
-//        recognizer.new_frame_ready = true;
-//        recognizer.frame_cond.notify_one();
-//
-//        {
-//            std::lock_guard<std::mutex> lock(recognizer.frame_mutex);
-//            cv::imshow("Face Recognition", recognizer.current_frame);
-//        }
-//
-//        if (cv::waitKey(30) == 27) {
-//            recognizer.stop = true;
-//            recognizer.frame_cond.notify_one();
-//            break;
-//        }
-//    }
-//
-//    recognition_thread.join();
-//    cap.release();
-//    cv::destroyAllWindows();
-//}
\ No newline at end of file
@@ -2,6 +2,7 @@
 
 #include <chrono>
 #include <iostream>
+#include <memory>
 #include <string>
 #include <vector>
 #include <filesystem>
@@ -22,8 +23,18 @@
 #include <mutex>
 #include <atomic>
 #include <condition_variable>
+#include <unordered_map>
 
 #include "User.hpp"
+#include "BoundedQueue.hpp"
+#include "DescriptorGallery.hpp"
+#include "DescriptorStore.hpp"
+#include "EmbeddingCache.hpp"
+#include "FaceDetector.hpp"
+#include "FaceTracker.hpp"
+#include "Metrics.hpp"
+#include "PrototypeCompaction.hpp"
+#include "SharedGallery.hpp"
 
 namespace fs = std::filesystem;
 using namespace dlib;
@@ -66,35 +77,111 @@ class FaceRecognizer {
 public:
     FaceRecognizer(UserRepository& userRepository);
     void trainModel();
-    void addUserToModel(int userId);
-    void recognizeFaces(cv::CascadeClassifier& face_cascade, std::vector<matrix<float, 0, 1>>& face_descriptors, std::vector<int>& labels, std::atomic<bool>& stop_flag);
+    // Appends the user's photos to the descriptor store and publishes a gallery snapshot that includes them
+    void addUserToModel(int userId, SharedGallery& gallery);
+    // Tombstones the user's rows and stops matching them, they are dropped from the file by the next --compact-store
+    void removeUserFromModel(int userId, SharedGallery& gallery);
+
+    // Models a recognition thread needs for itself: dlib's network and the face detector keep per-call state
+    struct Worker {
+        anet_type net;
+        std::unique_ptr<FaceDetector> detector;
+    };
+    // The worker's detector is made from the detector params
+    Worker makeWorker() const;
+
+    // Detects, tracks and identifies the faces of one camera frame. Safe to call from several workers as
+    // long as every camera's FaceTracker is used by one worker at a time. `timestamp` is when the frame was
+    // taken, recorded videos pass their own time so attendance is stored with it. `camera` names the camera
+    // or recording the frame comes from, it is stored with the attendance. Faces are only detected inside
+    // `regions` when there are any, see RecognitionScheduler. `detector` is the camera's own face detector,
+    // the worker's when null; like the FaceTracker it is used by one worker at a time.
+    void processFrame(const cv::Mat& frame, FaceTracker& face_tracker, Worker& worker, SharedGallery& gallery,
+        std::chrono::system_clock::time_point timestamp = std::chrono::system_clock::now(), const std::string& camera = {},
+        const std::vector<cv::Rect>& regions = {}, FaceDetector* detector = nullptr);
+    // Ends every track of a tracker whose video stopped, so their votes are released. The tracker is not used again.
+    void finishTracks(FaceTracker& face_tracker);
+
+    static constexpr const char* DESCRIPTOR_STORE_PATH = "models/face_descriptors.bin";
+    static constexpr const char* FULL_DESCRIPTOR_STORE_PATH = "models/face_descriptors_full.bin";
+    static constexpr const char* INDEX_PATH = "models/face_descriptors.hnsw";
+    static constexpr const char* SHAPE_PREDICTOR_PATH = "models/shape_predictor_68_face_landmarks.dat";
+    static constexpr const char* RESNET_PATH = "models/dlib_face_recognition_resnet_model_v1.dat";
+
+    // Geometry of the aligned face chips the ResNet embeds
+    static constexpr unsigned long FACE_CHIP_SIZE = 150;
+    static constexpr double FACE_CHIP_PADDING = 0.25;
 
     static dlib::frontal_face_detector detector;
-    std::mutex frame_mutex;
-    cv::Mat current_frame;
-    std::atomic<bool> new_frame_ready{ false };
-    std::atomic<bool> stop{ false };
-    std::condition_variable frame_cond;
     void markAttendance(int userId);
 
-    std::vector<std::string> updated_users;
+    // Upper bound on how many face chips go through the ResNet in one forward pass
+    void setMaxBatchSize(size_t batch_size);
+
+    // Association and re-embedding policy of the face tracks of every camera
+    void setTrackerParams(const FaceTracker::Params& params);
+    [[nodiscard]] FaceTracker::Params getTrackerParams() const;
+
+    // Backend, minimum face size and models of the face detectors of the workers and, unless a camera
+    // chooses its own backend, of every camera
+    void setDetectorParams(const FaceDetector::Params& params);
+    [[nodiscard]] FaceDetector::Params getDetectorParams() const;
+
+    // Detection workers used by trainModel/addUserToModel, 0 uses every hardware thread
+    void setTrainingThreads(size_t threads);
+
+    // 0 keeps one descriptor per enrollment photo. Otherwise models/face_descriptors.bin holds at most
+    // `count` prototypes per user and the per-photo descriptors are kept in face_descriptors_full.bin
+    void setPrototypesPerUser(size_t count, PrototypeMethod method = PrototypeMethod::Medoids);
+
+    [[nodiscard]] std::vector<std::string> getUpdatedUsers() const;
 
 private:
+    // How long a student seen by one camera's track stays attributed to it when another camera sees them too
+    static constexpr std::chrono::seconds CROSS_CAMERA_WINDOW{ 10 };
+
+    struct TrackOwner {
+        int track_id;
+        std::chrono::system_clock::time_point last_seen;
+    };
+
+    std::vector<matrix<float, 0, 1>> computeDescriptors(const std::vector<matrix<rgb_pixel>>& face_chips);
+    std::vector<matrix<float, 0, 1>> computeDescriptors(anet_type& network, const std::vector<matrix<rgb_pixel>>& face_chips) const;
+    // Track that collects the votes for `label`: cross-camera duplicates of a student are merged into one track
+    int attendanceTrack(int label, int track_id, std::chrono::system_clock::time_point timestamp);
+    void endTracks(const std::vector<int>& track_ids);
+    void listPhotos(int userId, std::vector<std::pair<std::string, int>>& photos) const;
+    // Descriptors of every photo with exactly one face, in the order of `photos`
+    void embedPhotos(const std::vector<std::pair<std::string, int>>& photos,
+        std::vector<matrix<float, 0, 1>>& face_descriptors, std::vector<int>& labels);
+    // Sets the model hash of the embedding cache on first use, which empties it when the models changed
+    void prepareEmbeddingCache();
+    void saveEmbeddingCache();
+    // Publishes a snapshot that owns its rows and waits for the older ones to drop the mapping of the main
+    // store, Windows refuses to replace a file that is still mapped
+    void releaseStoreMapping(SharedGallery& gallery);
+    // Rows that were added to the main store: the photos' descriptors, or their prototypes
+    void appendUserToStores(int userId, std::vector<matrix<float, 0, 1>>& gallery_rows, std::vector<int>& gallery_labels);
+    void saveModel(const std::vector<matrix<float, 0, 1>>& face_descriptors, const std::vector<int>& labels);
+
+    size_t max_batch_size = 32;
+    size_t training_threads = 0;
+    FaceTracker::Params tracker_params;
+    FaceDetector::Params detector_params;
+    size_t prototypes_per_user = 0;
+    PrototypeMethod prototype_method = PrototypeMethod::Medoids;
     dlib::shape_predictor sp;
+    // Enrollment's own network, recognition runs on the workers' copies. A forward pass keeps its state in
+    // the network, so enrollments on several threads and makeWorker copying it take turns.
     anet_type net;
+    mutable std::mutex network_mutex;
+    // Photos already embedded by an earlier trainModel/addUserToModel are not run through the models again
+    EmbeddingCache embedding_cache{ "models/embedding_cache.dat" };
+    std::once_flag model_hash_once;
     UserRepository& userRepository;
-};
 
+    mutable std::mutex attendance_mutex;
+    std::unordered_map<int, TrackOwner> track_owners;
+    std::vector<std::string> updated_users;
+};
 
-//class CameraManager {
-//public:
-//    CameraManager(FaceRecognizer& recognizer, cv::CascadeClassifier& face_cascade, std::vector<matrix<float, 0, 1>>& face_descriptors, std::vector<int>& labels, std::vector<std::string>& names);
-//    void start();
-//
-//private:
-//    FaceRecognizer& recognizer;
-//    cv::CascadeClassifier& face_cascade;
-//    std::vector<matrix<float, 0, 1>>& face_descriptors;
-//    std::vector<int>& labels;
-//    std::vector<std::string>& names;
-//};
\ No newline at end of file
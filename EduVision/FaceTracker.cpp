@@ -0,0 +1,183 @@
+#define _SILENCE_CXX17_CODECVT_HEADER_DEPRECATION_WARNING
+#define _SILENCE_ALL_CXX17_DEPRECATION_WARNINGS
+#define _CRT_SECURE_NO_WARNINGS
+
+#include "FaceTracker.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <tuple>
+#include <dlib/opencv/cv_image.h>
+
+namespace {
+    // Track ids stay unique across recognition threads and restarts, RecognitionTracker keys its votes by them
+    std::atomic<int> next_track_id{ 0 };
+
+    float intersectionOverUnion(const cv::Rect& a, const cv::Rect& b) {
+        const float intersection = static_cast<float>((a & b).area());
+        const float united = static_cast<float>(a.area() + b.area()) - intersection;
+        return united > 0.0f ? intersection / united : 0.0f;
+    }
+
+    // Constant velocity model over the box centre and size
+    cv::KalmanFilter makeKalman(const cv::Rect& box) {
+        cv::KalmanFilter kalman(8, 4, 0, CV_32F);
+        cv::setIdentity(kalman.transitionMatrix);
+        for (int i = 0; i < 4; ++i) {
+            kalman.transitionMatrix.at<float>(i, i + 4) = 1.0f;
+        }
+        cv::setIdentity(kalman.measurementMatrix);
+        cv::setIdentity(kalman.processNoiseCov, cv::Scalar::all(1e-2));
+        cv::setIdentity(kalman.measurementNoiseCov, cv::Scalar::all(1e-1));
+        cv::setIdentity(kalman.errorCovPost, cv::Scalar::all(1.0));
+        kalman.statePost.at<float>(0) = box.x + box.width * 0.5f;
+        kalman.statePost.at<float>(1) = box.y + box.height * 0.5f;
+        kalman.statePost.at<float>(2) = static_cast<float>(box.width);
+        kalman.statePost.at<float>(3) = static_cast<float>(box.height);
+        return kalman;
+    }
+
+    cv::Rect boxFromState(const cv::Mat& state) {
+        const float width = std::max(state.at<float>(2), 1.0f);
+        const float height = std::max(state.at<float>(3), 1.0f);
+        return cv::Rect(cvRound(state.at<float>(0) - width * 0.5f), cvRound(state.at<float>(1) - height * 0.5f), cvRound(width), cvRound(height));
+    }
+
+    cv::Mat measurementOf(const cv::Rect& box) {
+        return (cv::Mat_<float>(4, 1) << box.x + box.width * 0.5f, box.y + box.height * 0.5f,
+            static_cast<float>(box.width), static_cast<float>(box.height));
+    }
+}
+
+FaceTracker::FaceTracker(Params params) : params(params) {
+}
+
+std::vector<int> FaceTracker::update(const std::vector<cv::Rect>& detections, const cv::Mat& frame) {
+    for (Track& track : tracks) {
+        track.box = boxFromState(track.kalman.predict());
+        track.detected = false;
+    }
+
+    // Greedy association, best overlapping pairs first; a classroom rarely has overlapping faces
+    std::vector<std::tuple<float, size_t, size_t>> pairs;
+    for (size_t t = 0; t < tracks.size(); ++t) {
+        for (size_t d = 0; d < detections.size(); ++d) {
+            float iou = intersectionOverUnion(tracks[t].box, detections[d]);
+            if (iou >= params.min_iou) {
+                pairs.emplace_back(iou, t, d);
+            }
+        }
+    }
+    std::sort(pairs.begin(), pairs.end(), [](const auto& a, const auto& b) { return std::get<0>(a) > std::get<0>(b); });
+
+    std::vector<int> track_of(detections.size(), -1);
+    for (const auto& [iou, t, d] : pairs) {
+        if (tracks[t].detected || track_of[d] != -1) {
+            continue;
+        }
+        Track& track = tracks[t];
+        track.kalman.correct(measurementOf(detections[d]));
+        track.box = detections[d];
+        track.detected = true;
+        track.missed_frames = 0;
+        track_of[d] = track.id;
+    }
+
+    const cv::Rect bounds(0, 0, frame.cols, frame.rows);
+    std::optional<dlib::cv_image<dlib::bgr_pixel>> image;
+    if (params.use_correlation_tracker && !frame.empty()) {
+        image.emplace(frame);
+    }
+    for (Track& track : tracks) {
+        ++track.frames_since_embedding;
+        track.confidence *= track.detected ? params.confidence_decay : params.confidence_decay * params.confidence_decay;
+        if (!image) {
+            track.missed_frames += track.detected ? 0 : 1;
+            continue;
+        }
+
+        if (track.detected) {
+            cv::Rect box = track.box & bounds;
+            track.correlation.emplace();
+            track.correlation->start_track(*image, dlib::centered_rect(dlib::point(box.x + box.width / 2, box.y + box.height / 2), box.width, box.height));
+        }
+        else if (track.correlation && track.correlation->update(*image) >= params.min_correlation_psr) {
+            // The face is still there, the detector just missed it in this frame
+            dlib::drectangle position = track.correlation->get_position();
+            track.box = cv::Rect(cvRound(position.left()), cvRound(position.top()), cvRound(position.width()), cvRound(position.height()));
+            track.kalman.correct(measurementOf(track.box));
+        }
+        else {
+            ++track.missed_frames;
+        }
+    }
+
+    auto ended = std::remove_if(tracks.begin(), tracks.end(), [this](const Track& track) {
+        return track.missed_frames > params.max_missed_frames;
+    });
+    for (auto it = ended; it != tracks.end(); ++it) {
+        ended_tracks.push_back(it->id);
+    }
+    tracks.erase(ended, tracks.end());
+
+    for (size_t d = 0; d < detections.size(); ++d) {
+        if (track_of[d] == -1) {
+            track_of[d] = startTrack(detections[d], frame).id;
+        }
+    }
+    return track_of;
+}
+
+FaceTracker::Track& FaceTracker::startTrack(const cv::Rect& box, const cv::Mat& frame) {
+    Track track;
+    track.id = next_track_id++;
+    track.box = box;
+    track.detected = true;
+    track.kalman = makeKalman(box);
+    if (params.use_correlation_tracker && !frame.empty()) {
+        dlib::cv_image<dlib::bgr_pixel> image(frame);
+        cv::Rect clipped = box & cv::Rect(0, 0, frame.cols, frame.rows);
+        track.correlation.emplace();
+        track.correlation->start_track(image, dlib::centered_rect(dlib::point(clipped.x + clipped.width / 2, clipped.y + clipped.height / 2), clipped.width, clipped.height));
+    }
+    tracks.push_back(std::move(track));
+    return tracks.back();
+}
+
+bool FaceTracker::needsEmbedding(int track_id) const {
+    const Track* track = findTrack(track_id);
+    if (track == nullptr || !track->detected) {
+        return false;
+    }
+    return track->embeddings < params.confirm_embeddings
+        || track->confidence < params.min_confidence
+        || track->frames_since_embedding >= params.refresh_interval;
+}
+
+void FaceTracker::assignIdentity(int track_id, int label) {
+    Track* track = find(track_id);
+    if (track == nullptr) {
+        return;
+    }
+    // A disagreeing embedding leaves the track below the confidence threshold, so the next frame checks again
+    track->confidence = track->embeddings == 0 || label == track->label ? 1.0f : 0.5f * params.min_confidence;
+    track->label = label;
+    ++track->embeddings;
+    track->frames_since_embedding = 0;
+}
+
+const FaceTracker::Track* FaceTracker::findTrack(int track_id) const {
+    auto it = std::find_if(tracks.begin(), tracks.end(), [track_id](const Track& track) { return track.id == track_id; });
+    return it == tracks.end() ? nullptr : &*it;
+}
+
+FaceTracker::Track* FaceTracker::find(int track_id) {
+    auto it = std::find_if(tracks.begin(), tracks.end(), [track_id](const Track& track) { return track.id == track_id; });
+    return it == tracks.end() ? nullptr : &*it;
+}
+
+std::vector<int> FaceTracker::takeEndedTracks() {
+    std::vector<int> ended;
+    ended.swap(ended_tracks);
+    return ended;
+}
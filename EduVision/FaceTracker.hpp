@@ -0,0 +1,62 @@
+#pragma once
+
+#include <cstddef>
+#include <optional>
+#include <vector>
+#include <opencv2/core.hpp>
+#include <opencv2/video/tracking.hpp>
+#include <dlib/image_processing/correlation_tracker.h>
+
+// Keeps faces apart across frames so a face is not embedded again in every
+// frame. Detections are associated with tracks by IoU against each track's
+// Kalman-predicted box. The identity from the last embedding is cached per
+// track and decays, so a track asks for a new embedding when it is new, when
+// its confidence ran out, or on a periodic refresh.
+class FaceTracker {
+public:
+    struct Params {
+        float min_iou = 0.3f;                  // detections below this overlap start a new track
+        size_t max_missed_frames = 15;         // frames without a detection before a track ends
+        size_t confirm_embeddings = 5;         // a new track is embedded every frame until it has this many embeddings
+        size_t refresh_interval = 100;         // frames between embeddings of a confirmed track
+        float confidence_decay = 0.99f;        // per frame, a track that was not detected decays with its square
+        float min_confidence = 0.5f;           // below this the identity is embedded again
+        bool use_correlation_tracker = false;  // dlib correlation_tracker follows a track while the detector misses it
+        double min_correlation_psr = 7.0;      // peak-to-sidelobe ratio under which the correlation tracker is ignored
+    };
+
+    struct Track {
+        int id = -1;
+        cv::Rect box;
+        int label = -1;                 // cached identity, -1 for an unknown face
+        float confidence = 0.0f;
+        size_t embeddings = 0;
+        size_t frames_since_embedding = 0;
+        size_t missed_frames = 0;
+        bool detected = false;          // matched with a detection in the current frame
+        cv::KalmanFilter kalman;
+        std::optional<dlib::correlation_tracker> correlation;
+    };
+
+    explicit FaceTracker(Params params = {});
+
+    // Advances every track by one frame. Returns the track id of every detection, in detection order.
+    std::vector<int> update(const std::vector<cv::Rect>& detections, const cv::Mat& frame);
+
+    [[nodiscard]] bool needsEmbedding(int track_id) const;
+    // Result of embedding the detection of `track_id`, -1 when the gallery had no match
+    void assignIdentity(int track_id, int label);
+
+    [[nodiscard]] const Track* findTrack(int track_id) const;
+    [[nodiscard]] const std::vector<Track>& getTracks() const { return tracks; }
+    // Ids of the tracks that ended since the last call
+    std::vector<int> takeEndedTracks();
+
+private:
+    Track& startTrack(const cv::Rect& box, const cv::Mat& frame);
+    Track* find(int track_id);
+
+    Params params;
+    std::vector<Track> tracks;
+    std::vector<int> ended_tracks;
+};
@@ -0,0 +1,110 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <utility>
+
+// Lock-free, latest-wins hand-off from one producer to up to `max_readers`
+// concurrent readers. Values live in preallocated slots that are reused, so a
+// cv::Mat slot keeps its pixel buffer and capture decodes straight into it.
+// The producer never overwrites the latest value or a slot a reader holds;
+// readers always get the newest complete value and never wait.
+template <typename T>
+class FrameBuffer {
+    struct Slot {
+        T value;
+        std::atomic<uint32_t> readers{ 0 };
+    };
+
+public:
+    // Read access to one published value, released on destruction
+    class Lease {
+    public:
+        Lease() = default;
+        Lease(Lease&& other) noexcept : slot(std::exchange(other.slot, nullptr)), seq(other.seq) {}
+        Lease& operator=(Lease&& other) noexcept {
+            if (this != &other) {
+                release();
+                slot = std::exchange(other.slot, nullptr);
+                seq = other.seq;
+            }
+            return *this;
+        }
+        Lease(const Lease&) = delete;
+        Lease& operator=(const Lease&) = delete;
+        ~Lease() { release(); }
+
+        explicit operator bool() const { return slot != nullptr; }
+        const T& operator*() const { return slot->value; }
+        const T* operator->() const { return &slot->value; }
+        // 1 for the first published value, consecutive afterwards
+        [[nodiscard]] uint64_t sequence() const { return seq; }
+
+    private:
+        friend class FrameBuffer;
+        Lease(Slot* slot, uint64_t seq) : slot(slot), seq(seq) {}
+
+        void release() {
+            if (slot) {
+                slot->readers.fetch_sub(1);
+                slot = nullptr;
+            }
+        }
+
+        Slot* slot = nullptr;
+        uint64_t seq = 0;
+    };
+
+    explicit FrameBuffer(size_t max_readers = 2)
+        : slot_count(max_readers + 2), slots(new Slot[max_readers + 2]) {}
+
+    // Producer: slot to fill next, nullptr when every free slot is held by readers beyond max_readers
+    T* beginWrite() {
+        const size_t published = static_cast<size_t>(latest.load() & INDEX_MASK);
+        for (size_t i = 0; i < slot_count; ++i) {
+            if (i != published && slots[i].readers.load() == 0) {
+                writing = i;
+                return &slots[i].value;
+            }
+        }
+        return nullptr;
+    }
+
+    // Producer: publishes the slot returned by the last beginWrite()
+    void commitWrite() {
+        const uint64_t sequence = (latest.load() >> INDEX_BITS) + 1;
+        latest.store(sequence << INDEX_BITS | writing);
+    }
+
+    // Reader: newest published value, an empty lease before the first commit
+    Lease acquire() const {
+        uint64_t current = latest.load();
+        while ((current >> INDEX_BITS) != 0) {
+            Slot& slot = slots[current & INDEX_MASK];
+            slot.readers.fetch_add(1);
+            // The producer only writes slots that are neither latest nor read, so if this slot is
+            // still the latest one after registering as a reader it can not be overwritten any more
+            const uint64_t again = latest.load();
+            if (again == current) {
+                return Lease(&slot, current >> INDEX_BITS);
+            }
+            slot.readers.fetch_sub(1);
+            current = again;
+        }
+        return {};
+    }
+
+    [[nodiscard]] uint64_t latestSequence() const { return latest.load() >> INDEX_BITS; }
+
+private:
+    static constexpr uint64_t INDEX_BITS = 8;
+    static constexpr uint64_t INDEX_MASK = (1u << INDEX_BITS) - 1;
+
+    const size_t slot_count;
+    std::unique_ptr<Slot[]> slots;
+    size_t writing = 0;
+    // Sequence number of the latest value in the high bits, its slot in the low INDEX_BITS
+    std::atomic<uint64_t> latest{ 0 };
+};
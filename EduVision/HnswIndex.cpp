@@ -0,0 +1,301 @@
+#define _SILENCE_CXX17_CODECVT_HEADER_DEPRECATION_WARNING
+#define _SILENCE_ALL_CXX17_DEPRECATION_WARNINGS
+#define _CRT_SECURE_NO_WARNINGS
+
+#include "HnswIndex.hpp"
+#include "DescriptorGallery.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <iostream>
+#include <queue>
+#include <stdexcept>
+#include <dlib/serialize.h>
+
+namespace {
+    constexpr int HNSW_FILE_VERSION = 1;
+    constexpr int MAX_LEVEL = 16;
+
+    // Generation-tagged visited marks so a search never clears an O(n) array
+    struct VisitedList {
+        std::vector<uint32_t> marks;
+        uint32_t generation = 0;
+
+        void reset(size_t count) {
+            if (marks.size() < count) {
+                marks.resize(count, 0);
+            }
+            if (++generation == 0) {
+                std::fill(marks.begin(), marks.end(), 0);
+                generation = 1;
+            }
+        }
+
+        bool visit(uint32_t id) {
+            if (marks[id] == generation) {
+                return false;
+            }
+            marks[id] = generation;
+            return true;
+        }
+    };
+
+    thread_local VisitedList visited_list;
+}
+
+HnswIndex::HnswIndex(Params params) : params(params), rng(params.seed) {
+    if (this->params.M < 2) {
+        this->params.M = 2;
+    }
+}
+
+void HnswIndex::build(const DescriptorGallery& gallery) {
+    levels.clear();
+    base_links.clear();
+    upper_links.clear();
+    entry_point = 0;
+    max_level = -1;
+    rng.seed(params.seed);
+
+    levels.reserve(gallery.size());
+    base_links.reserve(gallery.size() * (2 * params.M + 1));
+    upper_links.reserve(gallery.size());
+    for (size_t i = 0; i < gallery.size(); ++i) {
+        insert(gallery, i);
+    }
+}
+
+uint32_t* HnswIndex::linksAt(uint32_t node, int level) {
+    if (level == 0) {
+        return base_links.data() + static_cast<size_t>(node) * (2 * params.M + 1);
+    }
+    return upper_links[node].data() + static_cast<size_t>(level - 1) * (params.M + 1);
+}
+
+const uint32_t* HnswIndex::linksAt(uint32_t node, int level) const {
+    if (level == 0) {
+        return base_links.data() + static_cast<size_t>(node) * (2 * params.M + 1);
+    }
+    return upper_links[node].data() + static_cast<size_t>(level - 1) * (params.M + 1);
+}
+
+int HnswIndex::randomLevel() {
+    std::uniform_real_distribution<double> uniform(0.0, 1.0);
+    double level = -std::log(1.0 - uniform(rng)) / std::log(static_cast<double>(params.M));
+    return std::min(static_cast<int>(level), MAX_LEVEL);
+}
+
+void HnswIndex::insert(const DescriptorGallery& gallery, size_t index) {
+    if (index != levels.size()) {
+        throw std::logic_error("HNSW rows must be inserted in gallery order");
+    }
+
+    const uint32_t node = static_cast<uint32_t>(index);
+    const int level = randomLevel();
+    levels.push_back(level);
+    base_links.resize(base_links.size() + 2 * params.M + 1, 0);
+    upper_links.emplace_back(static_cast<size_t>(level) * (params.M + 1), 0);
+
+    if (max_level < 0) {
+        entry_point = node;
+        max_level = level;
+        return;
+    }
+
+    alignas(32) float buffer[DescriptorGallery::DIMENSIONS];
+    const float* query = gallery.rowQuery(index, buffer);
+    uint32_t current = entry_point;
+    for (int l = max_level; l > level; --l) {
+        current = greedyClosest(gallery, query, current, l);
+    }
+    for (int l = std::min(level, max_level); l >= 0; --l) {
+        std::vector<Candidate> candidates = searchLayer(gallery, query, current, params.ef_construction, l);
+        current = candidates.front().second;
+        connect(gallery, node, selectNeighbors(gallery, std::move(candidates), params.M), l);
+    }
+
+    if (level > max_level) {
+        max_level = level;
+        entry_point = node;
+    }
+}
+
+uint32_t HnswIndex::greedyClosest(const DescriptorGallery& gallery, const float* query, uint32_t entry, int level) const {
+    uint32_t current = entry;
+    float best = gallery.rowDistance(query, current);
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        const uint32_t* links = linksAt(current, level);
+        for (uint32_t i = 1; i <= links[0]; ++i) {
+            float distance = gallery.rowDistance(query, links[i]);
+            if (distance < best) {
+                best = distance;
+                current = links[i];
+                changed = true;
+            }
+        }
+    }
+    return current;
+}
+
+std::vector<HnswIndex::Candidate> HnswIndex::searchLayer(const DescriptorGallery& gallery, const float* query, uint32_t entry, size_t ef, int level, bool skip_removed) const {
+    VisitedList& visited = visited_list;
+    visited.reset(levels.size());
+
+    std::priority_queue<Candidate, std::vector<Candidate>, std::greater<Candidate>> candidates;
+    std::priority_queue<Candidate> results;
+
+    float entry_distance = gallery.rowDistance(query, entry);
+    candidates.emplace(entry_distance, entry);
+    if (!skip_removed || !gallery.isRemoved(entry)) {
+        results.emplace(entry_distance, entry);
+    }
+    visited.visit(entry);
+
+    // Until ef results are found every neighbour is explored, so removed rows never end the search early
+    while (!candidates.empty()) {
+        Candidate closest = candidates.top();
+        if (results.size() >= ef && closest.first > results.top().first) {
+            break;
+        }
+        candidates.pop();
+
+        const uint32_t* links = linksAt(closest.second, level);
+        for (uint32_t i = 1; i <= links[0]; ++i) {
+            uint32_t neighbor = links[i];
+            if (!visited.visit(neighbor)) {
+                continue;
+            }
+            float distance = gallery.rowDistance(query, neighbor);
+            if (results.size() < ef || distance < results.top().first) {
+                candidates.emplace(distance, neighbor);
+                if (skip_removed && gallery.isRemoved(neighbor)) {
+                    continue;
+                }
+                results.emplace(distance, neighbor);
+                if (results.size() > ef) {
+                    results.pop();
+                }
+            }
+        }
+    }
+
+    std::vector<Candidate> sorted(results.size());
+    for (size_t i = sorted.size(); i > 0; --i) {
+        sorted[i - 1] = results.top();
+        results.pop();
+    }
+    return sorted;
+}
+
+std::vector<uint32_t> HnswIndex::selectNeighbors(const DescriptorGallery& gallery, std::vector<Candidate> candidates, size_t max_count) const {
+    // Keep a candidate only if it is closer to the new node than to every neighbour kept so far,
+    // which spreads links in different directions instead of into one dense cluster
+    std::vector<uint32_t> selected;
+    selected.reserve(max_count);
+    alignas(32) float buffer[DescriptorGallery::DIMENSIONS];
+    for (const Candidate& candidate : candidates) {
+        if (selected.size() >= max_count) {
+            break;
+        }
+        const float* candidate_query = selected.empty() ? nullptr : gallery.rowQuery(candidate.second, buffer);
+        bool keep = true;
+        for (uint32_t other : selected) {
+            if (gallery.rowDistance(candidate_query, other) < candidate.first) {
+                keep = false;
+                break;
+            }
+        }
+        if (keep) {
+            selected.push_back(candidate.second);
+        }
+    }
+    return selected;
+}
+
+void HnswIndex::connect(const DescriptorGallery& gallery, uint32_t node, const std::vector<uint32_t>& neighbors, int level) {
+    uint32_t* links = linksAt(node, level);
+    links[0] = static_cast<uint32_t>(neighbors.size());
+    std::copy(neighbors.begin(), neighbors.end(), links + 1);
+
+    const size_t capacity = maxLinks(level);
+    for (uint32_t neighbor : neighbors) {
+        uint32_t* their_links = linksAt(neighbor, level);
+        if (their_links[0] < capacity) {
+            their_links[1 + their_links[0]] = node;
+            ++their_links[0];
+            continue;
+        }
+
+        alignas(32) float buffer[DescriptorGallery::DIMENSIONS];
+        const float* base = gallery.rowQuery(neighbor, buffer);
+        std::vector<Candidate> candidates;
+        candidates.reserve(capacity + 1);
+        candidates.emplace_back(gallery.rowDistance(base, node), node);
+        for (uint32_t i = 1; i <= their_links[0]; ++i) {
+            candidates.emplace_back(gallery.rowDistance(base, their_links[i]), their_links[i]);
+        }
+        std::sort(candidates.begin(), candidates.end());
+        std::vector<uint32_t> kept = selectNeighbors(gallery, std::move(candidates), capacity);
+        their_links[0] = static_cast<uint32_t>(kept.size());
+        std::copy(kept.begin(), kept.end(), their_links + 1);
+    }
+}
+
+std::vector<std::pair<size_t, float>> HnswIndex::search(const DescriptorGallery& gallery, const float* query, size_t k, size_t ef) const {
+    std::vector<std::pair<size_t, float>> found;
+    if (max_level < 0 || k == 0) {
+        return found;
+    }
+
+    alignas(32) float buffer[DescriptorGallery::DIMENSIONS];
+    query = gallery.prepareQuery(query, buffer);
+    uint32_t current = entry_point;
+    for (int l = max_level; l > 0; --l) {
+        current = greedyClosest(gallery, query, current, l);
+    }
+    std::vector<Candidate> candidates = searchLayer(gallery, query, current, std::max(ef == 0 ? params.ef_search : ef, k), 0, true);
+
+    found.reserve(std::min(k, candidates.size()));
+    for (size_t i = 0; i < candidates.size() && i < k; ++i) {
+        found.emplace_back(candidates[i].second, candidates[i].first);
+    }
+    return found;
+}
+
+void HnswIndex::save(const std::string& path, uint64_t gallery_fingerprint) const {
+    dlib::serialize(path) << HNSW_FILE_VERSION << gallery_fingerprint
+        << static_cast<uint64_t>(params.M) << static_cast<uint64_t>(params.ef_construction)
+        << static_cast<uint64_t>(levels.size()) << entry_point << max_level
+        << levels << base_links << upper_links;
+}
+
+bool HnswIndex::load(const std::string& path, uint64_t gallery_fingerprint) {
+    try {
+        int version = 0;
+        uint64_t fingerprint = 0, M = 0, ef_construction = 0, count = 0;
+        dlib::deserialize in(path);
+        in >> version >> fingerprint;
+        if (version != HNSW_FILE_VERSION || fingerprint != gallery_fingerprint) {
+            return false;
+        }
+        in >> M >> ef_construction >> count >> entry_point >> max_level >> levels >> base_links >> upper_links;
+        params.M = static_cast<size_t>(M);
+        params.ef_construction = static_cast<size_t>(ef_construction);
+        if (levels.size() != count || base_links.size() != count * (2 * params.M + 1) || upper_links.size() != count) {
+            throw std::runtime_error("corrupted graph");
+        }
+        return true;
+    }
+    catch (const std::exception& e) {
+        std::cerr << "Error loading " << path << ": " << e.what() << std::endl;
+        levels.clear();
+        base_links.clear();
+        upper_links.clear();
+        entry_point = 0;
+        max_level = -1;
+        return false;
+    }
+}
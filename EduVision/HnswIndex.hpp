@@ -0,0 +1,67 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+
+class DescriptorGallery;
+
+// Hierarchical navigable small world graph over the rows of a DescriptorGallery.
+// The index only stores graph links, distances to the rows come from the gallery
+// passed to every call (fp32 or its quantized copy, see DescriptorGallery::rowDistance),
+// so rows must be appended in the same order they were inserted.
+class HnswIndex {
+public:
+    struct Params {
+        size_t M = 16;                  // links per node on the upper layers, 2*M on layer 0
+        size_t ef_construction = 200;   // candidate list size while building, higher = better graph
+        size_t ef_search = 64;          // candidate list size while querying, the recall/latency knob
+        unsigned int seed = 42;
+    };
+
+    HnswIndex() = default;
+    explicit HnswIndex(Params params);
+
+    void build(const DescriptorGallery& gallery);
+    // Links gallery row `index` into the graph, rows must be inserted in order
+    void insert(const DescriptorGallery& gallery, size_t index);
+
+    // Up to k (row, squared distance) pairs sorted by distance, ef = 0 uses params.ef_search. Rows of users
+    // removed from the gallery are never returned, the search still walks through them and goes on until
+    // it has live ones.
+    [[nodiscard]] std::vector<std::pair<size_t, float>> search(const DescriptorGallery& gallery, const float* query, size_t k, size_t ef = 0) const;
+
+    [[nodiscard]] size_t size() const { return levels.size(); }
+    [[nodiscard]] const Params& getParams() const { return params; }
+    void setEfSearch(size_t ef) { params.ef_search = ef; }
+
+    // The fingerprint ties a saved graph to the exact gallery contents it was built from
+    void save(const std::string& path, uint64_t gallery_fingerprint) const;
+    bool load(const std::string& path, uint64_t gallery_fingerprint);
+
+private:
+    using Candidate = std::pair<float, uint32_t>;
+
+    [[nodiscard]] uint32_t* linksAt(uint32_t node, int level);
+    [[nodiscard]] const uint32_t* linksAt(uint32_t node, int level) const;
+    [[nodiscard]] size_t maxLinks(int level) const { return level == 0 ? 2 * params.M : params.M; }
+    [[nodiscard]] int randomLevel();
+
+    uint32_t greedyClosest(const DescriptorGallery& gallery, const float* query, uint32_t entry, int level) const;
+    // `skip_removed` keeps removed rows out of the results, building the graph needs them in
+    std::vector<Candidate> searchLayer(const DescriptorGallery& gallery, const float* query, uint32_t entry, size_t ef, int level, bool skip_removed = false) const;
+    std::vector<uint32_t> selectNeighbors(const DescriptorGallery& gallery, std::vector<Candidate> candidates, size_t max_count) const;
+    void connect(const DescriptorGallery& gallery, uint32_t node, const std::vector<uint32_t>& neighbors, int level);
+
+    Params params;
+    std::vector<int> levels;
+    // Layer 0 links are one flat block of (count, 2*M ids) per node, upper layers are per node
+    std::vector<uint32_t> base_links;
+    std::vector<std::vector<uint32_t>> upper_links;
+    uint32_t entry_point = 0;
+    int max_level = -1;
+    std::mt19937 rng;
+};
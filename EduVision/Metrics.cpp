@@ -0,0 +1,256 @@
+#define _SILENCE_CXX17_CODECVT_HEADER_DEPRECATION_WARNING
+#define _SILENCE_ALL_CXX17_DEPRECATION_WARNINGS
+#define _CRT_SECURE_NO_WARNINGS
+
+#include "Metrics.hpp"
+
+#include <algorithm>
+#include <ctime>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+
+namespace {
+    constexpr double QUANTILES[] = { 0.5, 0.9, 0.99 };
+
+    size_t bitWidth(uint64_t value) {
+        size_t width = 0;
+        for (; value != 0; value >>= 1) {
+            ++width;
+        }
+        return width;
+    }
+}
+
+size_t Metrics::Histogram::bucketOf(uint64_t value_us) {
+    if (value_us < 2 * SUB_BUCKETS) {
+        return static_cast<size_t>(value_us);
+    }
+    // Shifted so that the value keeps 5 significant bits, 32 <= value >> shift < 64
+    const size_t shift = bitWidth(value_us) - 6;
+    const size_t bucket = 2 * SUB_BUCKETS + (shift - 1) * SUB_BUCKETS + static_cast<size_t>((value_us >> shift) - SUB_BUCKETS);
+    return std::min(bucket, BUCKETS - 1);
+}
+
+uint64_t Metrics::Histogram::bucketUpperBound(size_t bucket) {
+    if (bucket < 2 * SUB_BUCKETS) {
+        return bucket;
+    }
+    const size_t shift = (bucket - 2 * SUB_BUCKETS) / SUB_BUCKETS + 1;
+    const uint64_t sub_bucket = (bucket - 2 * SUB_BUCKETS) % SUB_BUCKETS + SUB_BUCKETS;
+    return ((sub_bucket + 1) << shift) - 1;
+}
+
+uint64_t Metrics::Histogram::percentile(double fraction) const {
+    if (count == 0) {
+        return 0;
+    }
+    const uint64_t rank = std::max<uint64_t>(1, static_cast<uint64_t>(fraction * count + 0.5));
+    uint64_t seen = 0;
+    for (size_t bucket = 0; bucket < BUCKETS; ++bucket) {
+        seen += counts[bucket];
+        if (seen >= rank) {
+            return bucketUpperBound(bucket);
+        }
+    }
+    return bucketUpperBound(BUCKETS - 1);
+}
+
+Metrics::Histogram Metrics::Histogram::since(const Histogram& earlier) const {
+    Histogram interval;
+    for (size_t bucket = 0; bucket < BUCKETS; ++bucket) {
+        interval.counts[bucket] = counts[bucket] - earlier.counts[bucket];
+    }
+    interval.count = count - earlier.count;
+    interval.sum_us = sum_us - earlier.sum_us;
+    return interval;
+}
+
+Metrics& Metrics::global() {
+    static Metrics metrics;
+    return metrics;
+}
+
+Metrics::ThreadHistograms& Metrics::threadHistograms() {
+    thread_local ThreadHistograms* histograms = nullptr;
+    if (histograms == nullptr) {
+        auto created = std::make_shared<ThreadHistograms>();
+        std::lock_guard<std::mutex> lock(threads_mutex);
+        threads.push_back(created);
+        histograms = created.get();
+    }
+    return *histograms;
+}
+
+void Metrics::record(Stage stage, std::chrono::steady_clock::duration duration) {
+    const auto microseconds = std::chrono::duration_cast<std::chrono::microseconds>(duration).count();
+    const uint64_t value_us = microseconds > 0 ? static_cast<uint64_t>(microseconds) : 0;
+    ThreadHistograms& histograms = threadHistograms();
+    const size_t index = static_cast<size_t>(stage);
+    histograms.counts[index][Histogram::bucketOf(value_us)].fetch_add(1, std::memory_order_relaxed);
+    histograms.sums_us[index].fetch_add(value_us, std::memory_order_relaxed);
+}
+
+Metrics::Snapshot Metrics::snapshot() const {
+    Snapshot snapshot;
+    snapshot.taken = std::chrono::steady_clock::now();
+    {
+        std::lock_guard<std::mutex> lock(threads_mutex);
+        for (const auto& histograms : threads) {
+            for (size_t stage = 0; stage < STAGE_COUNT; ++stage) {
+                Histogram& merged = snapshot.stages[stage];
+                for (size_t bucket = 0; bucket < Histogram::BUCKETS; ++bucket) {
+                    const uint64_t count = histograms->counts[stage][bucket].load(std::memory_order_relaxed);
+                    merged.counts[bucket] += count;
+                    merged.count += count;
+                }
+                merged.sum_us += histograms->sums_us[stage].load(std::memory_order_relaxed);
+            }
+        }
+    }
+    for (size_t i = 0; i < COUNTER_COUNT; ++i) {
+        snapshot.counters[i] = counters[i].load(std::memory_order_relaxed);
+    }
+    for (size_t i = 0; i < GAUGE_COUNT; ++i) {
+        snapshot.gauges[i] = gauges[i].load(std::memory_order_relaxed);
+    }
+    return snapshot;
+}
+
+const char* Metrics::stageName(Stage stage) {
+    switch (stage) {
+    case Stage::Frame: return "frame";
+    case Stage::Detection: return "detection";
+    case Stage::Landmarks: return "landmarks";
+    case Stage::Embedding: return "embedding";
+    case Stage::Matching: return "matching";
+    case Stage::Attendance: return "attendance";
+    case Stage::RepositoryRead: return "repository_read";
+    case Stage::RepositoryWrite: return "repository_write";
+    default: return "unknown";
+    }
+}
+
+const char* Metrics::counterName(Counter counter) {
+    switch (counter) {
+    case Counter::FramesCaptured: return "frames_captured";
+    case Counter::FramesDropped: return "frames_dropped";
+    case Counter::FramesProcessed: return "frames_processed";
+    case Counter::FacesEmbedded: return "faces_embedded";
+    case Counter::Recognitions: return "recognitions";
+    case Counter::FramesSkipped: return "frames_skipped";
+    default: return "unknown";
+    }
+}
+
+const char* Metrics::gaugeName(Gauge gauge) {
+    switch (gauge) {
+    case Gauge::FramesPending: return "frames_pending";
+    case Gauge::WorkersBusy: return "workers_busy";
+    case Gauge::EmbeddingQueueDepth: return "embedding_queue_depth";
+    case Gauge::AttendanceQueueDepth: return "attendance_queue_depth";
+    default: return "unknown";
+    }
+}
+
+std::string Metrics::formatPrometheus(const Snapshot& snapshot) {
+    std::ostringstream out;
+    for (size_t i = 0; i < COUNTER_COUNT; ++i) {
+        const std::string name = std::string("eduvision_") + counterName(static_cast<Counter>(i)) + "_total";
+        out << "# TYPE " << name << " counter\n" << name << " " << snapshot.counters[i] << "\n";
+    }
+    for (size_t i = 0; i < GAUGE_COUNT; ++i) {
+        const std::string name = std::string("eduvision_") + gaugeName(static_cast<Gauge>(i));
+        out << "# TYPE " << name << " gauge\n" << name << " " << snapshot.gauges[i] << "\n";
+    }
+    out << "# HELP eduvision_stage_latency_seconds Latency of a recognition pipeline stage since start\n"
+        << "# TYPE eduvision_stage_latency_seconds summary\n";
+    for (size_t i = 0; i < STAGE_COUNT; ++i) {
+        const Histogram& histogram = snapshot.stages[i];
+        const std::string stage = std::string("stage=\"") + stageName(static_cast<Stage>(i)) + "\"";
+        for (double quantile : QUANTILES) {
+            out << "eduvision_stage_latency_seconds{" << stage << ",quantile=\"" << quantile << "\"} "
+                << histogram.percentile(quantile) / 1e6 << "\n";
+        }
+        out << "eduvision_stage_latency_seconds_sum{" << stage << "} " << histogram.sum_us / 1e6 << "\n"
+            << "eduvision_stage_latency_seconds_count{" << stage << "} " << histogram.count << "\n";
+    }
+    return out.str();
+}
+
+std::string Metrics::formatJson(const Snapshot& current, const Snapshot& previous) {
+    const double seconds = std::chrono::duration<double>(current.taken - previous.taken).count();
+    std::time_t now = std::time(nullptr);
+    std::ostringstream out;
+    out << "{\"time\":\"" << std::put_time(std::localtime(&now), "%Y-%m-%dT%H:%M:%S") << "\",\"interval_s\":" << seconds;
+    for (size_t i = 0; i < COUNTER_COUNT; ++i) {
+        const uint64_t delta = current.counters[i] - previous.counters[i];
+        out << ",\"" << counterName(static_cast<Counter>(i)) << "_per_s\":" << (seconds > 0.0 ? delta / seconds : 0.0);
+    }
+    for (size_t i = 0; i < GAUGE_COUNT; ++i) {
+        out << ",\"" << gaugeName(static_cast<Gauge>(i)) << "\":" << current.gauges[i];
+    }
+    out << ",\"stages\":{";
+    for (size_t i = 0; i < STAGE_COUNT; ++i) {
+        const Histogram interval = current.stages[i].since(previous.stages[i]);
+        out << (i == 0 ? "" : ",") << "\"" << stageName(static_cast<Stage>(i)) << "\":{\"count\":" << interval.count
+            << ",\"p50_us\":" << interval.percentile(0.5) << ",\"p99_us\":" << interval.percentile(0.99)
+            << ",\"max_us\":" << interval.percentile(1.0) << "}";
+    }
+    out << "}}";
+    return out.str();
+}
+
+MetricsExporter::MetricsExporter(std::string prometheus_path, std::string json_log_path, std::chrono::seconds interval)
+    : prometheus_path(std::move(prometheus_path)), json_log_path(std::move(json_log_path)),
+    interval(interval.count() > 0 ? interval : std::chrono::seconds(1)), previous(Metrics::global().snapshot()) {
+    thread = std::thread(&MetricsExporter::run, this);
+}
+
+MetricsExporter::~MetricsExporter() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    thread.join();
+    exportNow();
+}
+
+void MetricsExporter::run() {
+    std::unique_lock<std::mutex> lock(mutex);
+    while (!wake.wait_for(lock, interval, [this] { return stopping; })) {
+        lock.unlock();
+        exportNow();
+        lock.lock();
+    }
+}
+
+void MetricsExporter::exportNow() {
+    std::lock_guard<std::mutex> lock(export_mutex);
+    Metrics::Snapshot current = Metrics::global().snapshot();
+    try {
+        if (!prometheus_path.empty()) {
+            // Written next to the target and renamed, so a scraper never reads half a file
+            const std::string temporary = prometheus_path + ".tmp";
+            {
+                std::ofstream out(temporary, std::ios::trunc);
+                out << Metrics::formatPrometheus(current);
+                if (!out) {
+                    throw std::runtime_error("Unable to write " + temporary);
+                }
+            }
+            std::filesystem::rename(temporary, prometheus_path);
+        }
+        if (!json_log_path.empty()) {
+            std::ofstream log(json_log_path, std::ios::app);
+            log << Metrics::formatJson(current, previous) << "\n";
+        }
+    }
+    catch (const std::exception& e) {
+        std::cerr << "Error exporting metrics: " << e.what() << std::endl;
+    }
+    previous = std::move(current);
+}
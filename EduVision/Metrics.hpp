@@ -0,0 +1,161 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Process-wide instrumentation of the recognition pipeline. Stage latencies go
+// into log-linear (HDR style, ~3% precision) histograms that every thread keeps
+// for itself, so recording is a few relaxed atomic increments without a lock;
+// snapshot() merges them. Counters and gauges are plain atomics.
+class Metrics {
+public:
+    enum class Stage {
+        Frame,            // processFrame as a whole
+        Detection,
+        Landmarks,        // shape predictor and chip extraction
+        Embedding,        // ResNet forward pass
+        Matching,
+        Attendance,       // vote and attendance write under the attendance lock
+        RepositoryRead,
+        RepositoryWrite,
+        Count
+    };
+
+    enum class Counter {
+        FramesCaptured,   // grabbed from the sources, decoded or not
+        FramesDropped,    // captured frames no worker recognized
+        FramesProcessed,
+        FacesEmbedded,
+        Recognitions,     // attendances marked
+        FramesSkipped,    // taken by a worker but not recognized: static, or over the CPU budget
+        Count
+    };
+
+    enum class Gauge {
+        FramesPending,    // cameras with a frame waiting for a worker
+        WorkersBusy,
+        EmbeddingQueueDepth,
+        AttendanceQueueDepth,  // attendance records waiting for the writer thread
+        Count
+    };
+
+    static constexpr size_t STAGE_COUNT = static_cast<size_t>(Stage::Count);
+    static constexpr size_t COUNTER_COUNT = static_cast<size_t>(Counter::Count);
+    static constexpr size_t GAUGE_COUNT = static_cast<size_t>(Gauge::Count);
+
+    // Latency histogram in microseconds: exact below 64us, then 32 buckets per power of two
+    struct Histogram {
+        static constexpr size_t SUB_BUCKETS = 32;
+        static constexpr size_t BUCKETS = 2 * SUB_BUCKETS + 30 * SUB_BUCKETS;
+
+        std::array<uint64_t, BUCKETS> counts{};
+        uint64_t count = 0;
+        uint64_t sum_us = 0;
+
+        static size_t bucketOf(uint64_t value_us);
+        // Largest value that falls into `bucket`
+        static uint64_t bucketUpperBound(size_t bucket);
+
+        [[nodiscard]] uint64_t percentile(double fraction) const;
+        // Counts recorded since `earlier`, a previous snapshot of the same histogram
+        [[nodiscard]] Histogram since(const Histogram& earlier) const;
+    };
+
+    struct Snapshot {
+        std::chrono::steady_clock::time_point taken;
+        std::array<Histogram, STAGE_COUNT> stages;
+        std::array<uint64_t, COUNTER_COUNT> counters{};
+        std::array<int64_t, GAUGE_COUNT> gauges{};
+    };
+
+    // Records the time from construction to destruction (or stop()) as one sample of `stage`
+    class Timer {
+    public:
+        explicit Timer(Stage stage) : stage(stage), start(std::chrono::steady_clock::now()) {}
+        Timer(const Timer&) = delete;
+        Timer& operator=(const Timer&) = delete;
+        ~Timer() { stop(); }
+
+        void stop() {
+            if (running) {
+                running = false;
+                Metrics::global().record(stage, std::chrono::steady_clock::now() - start);
+            }
+        }
+
+    private:
+        Stage stage;
+        std::chrono::steady_clock::time_point start;
+        bool running = true;
+    };
+
+    static Metrics& global();
+
+    void record(Stage stage, std::chrono::steady_clock::duration duration);
+    void add(Counter counter, uint64_t value = 1) { counters[static_cast<size_t>(counter)].fetch_add(value, std::memory_order_relaxed); }
+    void set(Gauge gauge, int64_t value) { gauges[static_cast<size_t>(gauge)].store(value, std::memory_order_relaxed); }
+    void add(Gauge gauge, int64_t value) { gauges[static_cast<size_t>(gauge)].fetch_add(value, std::memory_order_relaxed); }
+
+    [[nodiscard]] Snapshot snapshot() const;
+
+    // Prometheus text exposition format: counters, gauges and a summary per stage
+    static std::string formatPrometheus(const Snapshot& snapshot);
+    // One line of JSON with the rates and latency percentiles between two snapshots
+    static std::string formatJson(const Snapshot& current, const Snapshot& previous);
+
+    static const char* stageName(Stage stage);
+    static const char* counterName(Counter counter);
+    static const char* gaugeName(Gauge gauge);
+
+private:
+    // Histograms of one thread, written only by that thread
+    struct ThreadHistograms {
+        std::array<std::array<std::atomic<uint64_t>, Histogram::BUCKETS>, STAGE_COUNT> counts{};
+        std::array<std::atomic<uint64_t>, STAGE_COUNT> sums_us{};
+    };
+
+    Metrics() = default;
+    ThreadHistograms& threadHistograms();
+
+    mutable std::mutex threads_mutex;
+    // Histograms outlive their threads so their samples stay in the totals
+    std::vector<std::shared_ptr<ThreadHistograms>> threads;
+    std::array<std::atomic<uint64_t>, COUNTER_COUNT> counters{};
+    std::array<std::atomic<int64_t>, GAUGE_COUNT> gauges{};
+};
+
+// Periodically merges the metrics and writes them as a Prometheus text file (for node_exporter's
+// textfile collector) and as a JSON line appended to a log. Either path may be empty.
+class MetricsExporter {
+public:
+    MetricsExporter(std::string prometheus_path, std::string json_log_path, std::chrono::seconds interval);
+    ~MetricsExporter();
+
+    MetricsExporter(const MetricsExporter&) = delete;
+    MetricsExporter& operator=(const MetricsExporter&) = delete;
+
+    // Writes the current values, also done on every interval and on destruction
+    void exportNow();
+
+private:
+    void run();
+
+    std::string prometheus_path;
+    std::string json_log_path;
+    std::chrono::seconds interval;
+    std::mutex export_mutex;
+    Metrics::Snapshot previous;
+    std::mutex mutex;
+    std::condition_variable wake;
+    bool stopping = false;
+    std::thread thread;
+};
@@ -0,0 +1,219 @@
+#define _SILENCE_CXX17_CODECVT_HEADER_DEPRECATION_WARNING
+#define _SILENCE_ALL_CXX17_DEPRECATION_WARNINGS
+#define _CRT_SECURE_NO_WARNINGS
+
+#include "PrototypeCompaction.hpp"
+#include "DescriptorGallery.hpp"
+#include "DescriptorStore.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <limits>
+#include <map>
+
+namespace {
+    using Descriptor = dlib::matrix<float, 0, 1>;
+
+    constexpr size_t MAX_ITERATIONS = 20;
+
+    float squaredDistance(const Descriptor& a, const Descriptor& b) {
+        return DescriptorGallery::squaredDistance(&a(0), &b(0));
+    }
+
+    Descriptor meanOf(const std::vector<const Descriptor*>& members) {
+        Descriptor mean(static_cast<long>(DescriptorGallery::DIMENSIONS));
+        for (long i = 0; i < mean.size(); ++i) {
+            mean(i) = 0.0f;
+        }
+        for (const Descriptor* member : members) {
+            for (long i = 0; i < mean.size(); ++i) {
+                mean(i) += (*member)(i);
+            }
+        }
+        for (long i = 0; i < mean.size(); ++i) {
+            mean(i) /= static_cast<float>(members.size());
+        }
+        return mean;
+    }
+
+    const Descriptor* medoidOf(const std::vector<const Descriptor*>& members) {
+        const Descriptor* best = members.front();
+        float best_cost = std::numeric_limits<float>::max();
+        for (const Descriptor* candidate : members) {
+            float cost = 0.0f;
+            for (const Descriptor* other : members) {
+                cost += squaredDistance(*candidate, *other);
+            }
+            if (cost < best_cost) {
+                best_cost = cost;
+                best = candidate;
+            }
+        }
+        return best;
+    }
+
+    std::vector<Descriptor> prototypesOf(const std::vector<const Descriptor*>& photos, size_t count, PrototypeMethod method) {
+        if (photos.size() <= count) {
+            std::vector<Descriptor> all;
+            for (const Descriptor* photo : photos) {
+                all.push_back(*photo);
+            }
+            return all;
+        }
+        if (count == 1) {
+            return { method == PrototypeMethod::Mean ? meanOf(photos) : *medoidOf(photos) };
+        }
+
+        // Farthest-point seeding from the medoid keeps the result deterministic and spreads the
+        // initial prototypes over poses/lighting conditions instead of duplicates of one shot
+        std::vector<Descriptor> centers{ *medoidOf(photos) };
+        std::vector<float> nearest(photos.size(), std::numeric_limits<float>::max());
+        while (centers.size() < count) {
+            size_t farthest = 0;
+            for (size_t i = 0; i < photos.size(); ++i) {
+                nearest[i] = std::min(nearest[i], squaredDistance(*photos[i], centers.back()));
+                if (nearest[i] > nearest[farthest]) {
+                    farthest = i;
+                }
+            }
+            centers.push_back(*photos[farthest]);
+        }
+
+        std::vector<size_t> assignment(photos.size(), count);
+        for (size_t iteration = 0; iteration < MAX_ITERATIONS; ++iteration) {
+            bool changed = false;
+            for (size_t i = 0; i < photos.size(); ++i) {
+                size_t closest = 0;
+                float closest_distance = std::numeric_limits<float>::max();
+                for (size_t c = 0; c < centers.size(); ++c) {
+                    float distance = squaredDistance(*photos[i], centers[c]);
+                    if (distance < closest_distance) {
+                        closest_distance = distance;
+                        closest = c;
+                    }
+                }
+                changed |= assignment[i] != closest;
+                assignment[i] = closest;
+            }
+            if (!changed) {
+                break;
+            }
+
+            std::vector<Descriptor> updated;
+            for (size_t c = 0; c < centers.size(); ++c) {
+                std::vector<const Descriptor*> members;
+                for (size_t i = 0; i < photos.size(); ++i) {
+                    if (assignment[i] == c) {
+                        members.push_back(photos[i]);
+                    }
+                }
+                if (!members.empty()) {
+                    updated.push_back(method == PrototypeMethod::Mean ? meanOf(members) : *medoidOf(members));
+                }
+            }
+            if (updated.size() != centers.size()) {
+                // A cluster emptied out, the remaining ones get re-assigned on the next pass
+                std::fill(assignment.begin(), assignment.end(), count);
+            }
+            centers = std::move(updated);
+        }
+        return centers;
+    }
+
+    std::map<int, std::vector<const Descriptor*>> groupByLabel(const std::vector<Descriptor>& descriptors, const std::vector<int>& labels) {
+        std::map<int, std::vector<const Descriptor*>> photos;
+        for (size_t i = 0; i < descriptors.size(); ++i) {
+            photos[labels[i]].push_back(&descriptors[i]);
+        }
+        return photos;
+    }
+
+    void identify(const DescriptorGallery& gallery, const std::vector<Descriptor>& probes, const std::vector<int>& truth,
+        float max_distance, size_t& correct, size_t& wrong, double& us_per_probe) {
+        auto begin = std::chrono::steady_clock::now();
+        std::vector<DescriptorGallery::Match> matches = gallery.findNearest(probes, max_distance);
+        auto end = std::chrono::steady_clock::now();
+        us_per_probe = probes.empty() ? 0.0 : std::chrono::duration<double, std::micro>(end - begin).count() / probes.size();
+        for (size_t i = 0; i < matches.size(); ++i) {
+            if (matches[i].label == truth[i]) {
+                ++correct;
+            }
+            else if (matches[i].label != -1) {
+                ++wrong;
+            }
+        }
+    }
+}
+
+void compactDescriptors(const std::vector<Descriptor>& descriptors, const std::vector<int>& labels,
+    size_t prototypes_per_user, PrototypeMethod method,
+    std::vector<Descriptor>& compact_descriptors, std::vector<int>& compact_labels) {
+    compact_descriptors.clear();
+    compact_labels.clear();
+    for (const auto& [label, photos] : groupByLabel(descriptors, labels)) {
+        for (Descriptor& prototype : prototypesOf(photos, std::max<size_t>(prototypes_per_user, 1), method)) {
+            compact_descriptors.push_back(std::move(prototype));
+            compact_labels.push_back(label);
+        }
+    }
+}
+
+CompactionReport evaluateCompaction(const std::vector<Descriptor>& descriptors, const std::vector<int>& labels,
+    size_t prototypes_per_user, PrototypeMethod method, float max_distance, size_t holdout_every) {
+    CompactionReport report;
+    holdout_every = std::max<size_t>(holdout_every, 2);
+
+    std::vector<Descriptor> enrolled, probes;
+    std::vector<int> enrolled_labels, probe_labels;
+    for (const auto& [label, photos] : groupByLabel(descriptors, labels)) {
+        ++report.users;
+        for (size_t i = 0; i < photos.size(); ++i) {
+            bool probe = photos.size() > 1 && i % holdout_every == holdout_every - 1;
+            (probe ? probes : enrolled).push_back(*photos[i]);
+            (probe ? probe_labels : enrolled_labels).push_back(label);
+        }
+    }
+
+    std::vector<Descriptor> compact;
+    std::vector<int> compact_labels;
+    compactDescriptors(enrolled, enrolled_labels, prototypes_per_user, method, compact, compact_labels);
+
+    DescriptorGallery full_gallery(enrolled, enrolled_labels);
+    DescriptorGallery compact_gallery(compact, compact_labels);
+    report.probes = probes.size();
+    report.full_rows = full_gallery.size();
+    report.compact_rows = compact_gallery.size();
+    identify(full_gallery, probes, probe_labels, max_distance, report.full_correct, report.full_wrong, report.full_us_per_probe);
+    identify(compact_gallery, probes, probe_labels, max_distance, report.compact_correct, report.compact_wrong, report.compact_us_per_probe);
+    return report;
+}
+
+auto operator<<(std::ostream& os, const CompactionReport& report) -> std::ostream& {
+    auto rate = [&report](size_t count) {
+        return report.probes == 0 ? 0.0 : 100.0 * static_cast<double>(count) / static_cast<double>(report.probes);
+    };
+    return os << "Compaction report: " << report.users << " users, " << report.probes << " held-out probes\n"
+        << "  full gallery:    " << report.full_rows << " rows, correct " << rate(report.full_correct)
+        << "%, wrong identity " << rate(report.full_wrong) << "%, rejected "
+        << rate(report.probes - report.full_correct - report.full_wrong) << "%, "
+        << report.full_us_per_probe << " us/probe\n"
+        << "  compact gallery: " << report.compact_rows << " rows, correct " << rate(report.compact_correct)
+        << "%, wrong identity " << rate(report.compact_wrong) << "%, rejected "
+        << rate(report.probes - report.compact_correct - report.compact_wrong) << "%, "
+        << report.compact_us_per_probe << " us/probe\n";
+}
+
+void compactModelFile(const std::string& full_path, const std::string& compact_path,
+    size_t prototypes_per_user, PrototypeMethod method, std::ostream& out) {
+    std::vector<Descriptor> descriptors;
+    std::vector<int> labels;
+    DescriptorStore(full_path).read(descriptors, labels);
+
+    out << evaluateCompaction(descriptors, labels, prototypes_per_user, method);
+
+    std::vector<Descriptor> compact;
+    std::vector<int> compact_labels;
+    compactDescriptors(descriptors, labels, prototypes_per_user, method, compact, compact_labels);
+    DescriptorStore::write(compact_path, compact, compact_labels);
+    out << "Wrote " << compact.size() << " prototypes for " << descriptors.size() << " descriptors to " << compact_path << "\n";
+}
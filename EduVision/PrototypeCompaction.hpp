@@ -0,0 +1,44 @@
+#pragma once
+
+#include <cstddef>
+#include <ostream>
+#include <string>
+#include <vector>
+#include <dlib/matrix.h>
+
+// How a user's enrollment descriptors are reduced to prototypes
+enum class PrototypeMethod {
+    Mean,       // k-means centroids, a single prototype is the plain average
+    Medoids     // k-medoids, every prototype is one of the user's real photos
+};
+
+// Replaces every label's descriptors with at most `prototypes_per_user` prototypes.
+// Prototypes keep the label of the user they were computed from, so the
+// descriptor/label pairing of the descriptor store stays intact.
+void compactDescriptors(const std::vector<dlib::matrix<float, 0, 1>>& descriptors, const std::vector<int>& labels,
+    size_t prototypes_per_user, PrototypeMethod method,
+    std::vector<dlib::matrix<float, 0, 1>>& compact_descriptors, std::vector<int>& compact_labels);
+
+// Identification quality of the full gallery versus its compacted form. Every
+// `holdout_every`-th photo of a user is kept out of both galleries and used as a probe.
+struct CompactionReport {
+    size_t users = 0;
+    size_t probes = 0;
+    size_t full_rows = 0;
+    size_t compact_rows = 0;
+    size_t full_correct = 0;
+    size_t full_wrong = 0;
+    size_t compact_correct = 0;
+    size_t compact_wrong = 0;
+    double full_us_per_probe = 0.0;
+    double compact_us_per_probe = 0.0;
+};
+
+CompactionReport evaluateCompaction(const std::vector<dlib::matrix<float, 0, 1>>& descriptors, const std::vector<int>& labels,
+    size_t prototypes_per_user, PrototypeMethod method, float max_distance = 0.6f, size_t holdout_every = 5);
+
+auto operator<<(std::ostream& os, const CompactionReport& report)->std::ostream&;
+
+// Offline command: reads the full gallery, prints the accuracy report and writes the compacted gallery
+void compactModelFile(const std::string& full_path, const std::string& compact_path,
+    size_t prototypes_per_user, PrototypeMethod method, std::ostream& out);
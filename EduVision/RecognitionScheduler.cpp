@@ -0,0 +1,134 @@
+#define _SILENCE_CXX17_CODECVT_HEADER_DEPRECATION_WARNING
+#define _SILENCE_ALL_CXX17_DEPRECATION_WARNINGS
+#define _CRT_SECURE_NO_WARNINGS
+
+#include "RecognitionScheduler.hpp"
+
+#include <algorithm>
+#include <opencv2/imgproc.hpp>
+
+namespace {
+    // Regions grow by this fraction of their size on every side, and to at least MIN_REGION_SIZE,
+    // so the detector sees a whole face with some room around it
+    constexpr double REGION_MARGIN = 0.25;
+    constexpr int MIN_REGION_SIZE = 120;
+
+    cv::Rect grow(const cv::Rect& box, const cv::Size& bounds) {
+        const int dx = std::max(static_cast<int>(box.width * REGION_MARGIN), (MIN_REGION_SIZE - box.width + 1) / 2);
+        const int dy = std::max(static_cast<int>(box.height * REGION_MARGIN), (MIN_REGION_SIZE - box.height + 1) / 2);
+        return cv::Rect(box.x - dx, box.y - dy, box.width + 2 * dx, box.height + 2 * dy) & cv::Rect(cv::Point(0, 0), bounds);
+    }
+
+    // Joins overlapping boxes until none overlap, so no face is detected twice
+    std::vector<cv::Rect> merge(std::vector<cv::Rect> boxes) {
+        for (bool merged = true; merged;) {
+            merged = false;
+            for (size_t i = 0; i < boxes.size() && !merged; ++i) {
+                for (size_t j = i + 1; j < boxes.size(); ++j) {
+                    if ((boxes[i] & boxes[j]).area() > 0) {
+                        boxes[i] |= boxes[j];
+                        boxes.erase(boxes.begin() + j);
+                        merged = true;
+                        break;
+                    }
+                }
+            }
+        }
+        return boxes;
+    }
+}
+
+RecognitionScheduler::RecognitionScheduler(Params params) : params(params) {
+}
+
+RecognitionScheduler::Decision RecognitionScheduler::evaluate(const cv::Mat& frame, const std::vector<cv::Rect>& tracked,
+    std::chrono::steady_clock::time_point now) {
+    Decision decision;
+    bool moving = true;
+    cv::Mat mask;
+    double scale = 1.0;
+    if (params.motion_gating && !frame.empty()) {
+        scale = static_cast<double>(std::min(params.analysis_width, frame.cols)) / frame.cols;
+        cv::Mat small;
+        cv::resize(frame, small, cv::Size(), scale, scale, cv::INTER_AREA);
+        if (small.channels() == 1) {
+            gray = small;
+        }
+        else {
+            cv::cvtColor(small, gray, cv::COLOR_BGR2GRAY);
+        }
+        // Sensor noise is smoothed away before differencing
+        cv::GaussianBlur(gray, gray, cv::Size(5, 5), 0);
+
+        if (background.empty() || background.size() != gray.size()) {
+            gray.convertTo(background, CV_32F);
+            decision.changed_fraction = 1.0;
+        }
+        else {
+            cv::Mat reference;
+            background.convertTo(reference, CV_8U);
+            cv::absdiff(gray, reference, mask);
+            cv::threshold(mask, mask, params.pixel_threshold, 255, cv::THRESH_BINARY);
+            decision.changed_fraction = static_cast<double>(cv::countNonZero(mask)) / mask.total();
+            // Whoever keeps still becomes part of the background after a few dozen frames
+            cv::accumulateWeighted(gray, background, params.background_rate);
+            moving = decision.changed_fraction >= params.min_changed_fraction;
+        }
+    }
+
+    const bool keepalive_due = now - last_processed >= params.keepalive;
+    if (!moving && !motion_pending && !keepalive_due) {
+        return decision;
+    }
+    if (now < next_allowed) {
+        // Over the budget; the change is still recognized on the next frame the budget allows
+        motion_pending = motion_pending || moving;
+        return decision;
+    }
+
+    decision.process = true;
+    last_processed = now;
+    // Only a change in this very frame can be located, anything else is detected in the whole frame
+    if (moving && !mask.empty() && !motion_pending && !keepalive_due) {
+        std::vector<cv::Rect> regions = changedRegions(mask, scale, frame.size());
+        for (const cv::Rect& box : tracked) {
+            regions.push_back(grow(box, frame.size()));
+        }
+        regions = merge(std::move(regions));
+        double area = 0.0;
+        for (const cv::Rect& region : regions) {
+            area += region.area();
+        }
+        if (area <= params.max_region_fraction * frame.total()) {
+            decision.regions = std::move(regions);
+        }
+    }
+    motion_pending = false;
+    return decision;
+}
+
+void RecognitionScheduler::finished(std::chrono::steady_clock::duration processing, std::chrono::steady_clock::time_point now) {
+    if (params.cpu_cores <= 0.0 || params.cpu_cores >= 1.0) {
+        return;
+    }
+    // Busy for `processing`, so idle long enough that the busy share is cpu_cores
+    next_allowed = now + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+        processing * ((1.0 - params.cpu_cores) / params.cpu_cores));
+}
+
+std::vector<cv::Rect> RecognitionScheduler::changedRegions(const cv::Mat& mask, double scale, const cv::Size& frame_size) const {
+    // Joins the fragments of one moving person into one blob
+    cv::Mat joined;
+    cv::dilate(mask, joined, cv::Mat(), cv::Point(-1, -1), 2);
+    std::vector<std::vector<cv::Point>> contours;
+    cv::findContours(joined, contours, cv::RETR_EXTERNAL, cv::CHAIN_APPROX_SIMPLE);
+
+    std::vector<cv::Rect> regions;
+    regions.reserve(contours.size());
+    for (const auto& contour : contours) {
+        cv::Rect box = cv::boundingRect(contour);
+        cv::Rect full(cvFloor(box.x / scale), cvFloor(box.y / scale), cvCeil(box.width / scale), cvCeil(box.height / scale));
+        regions.push_back(grow(full, frame_size));
+    }
+    return regions;
+}
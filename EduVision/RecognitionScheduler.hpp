@@ -0,0 +1,52 @@
+#pragma once
+
+#include <chrono>
+#include <vector>
+#include <opencv2/core.hpp>
+
+// Decides for every frame of one camera whether recognition runs on it, and where. A small
+// blurred gray copy of the frame is compared with a background that slowly follows the scene;
+// frames without enough changed pixels are skipped, and otherwise detection is restricted to
+// the changed regions plus the faces already tracked. A static scene is still recognized every
+// `keepalive`, and the time spent recognizing is held to the camera's share of the CPU budget.
+// Used by one recognition worker at a time, like the camera's FaceTracker.
+class RecognitionScheduler {
+public:
+    struct Params {
+        bool motion_gating = true;               // false recognizes every frame the budget allows
+        int analysis_width = 160;                // width of the gray image motion is measured on
+        int pixel_threshold = 20;                // gray level change for a pixel to count as changed
+        double min_changed_fraction = 0.002;     // of the analysed pixels, fewer changed make a static frame
+        double background_rate = 0.05;           // weight of a new frame in the background
+        double max_region_fraction = 0.5;        // more of the frame changed and the whole frame is detected
+        std::chrono::milliseconds keepalive{ 10000 };  // the longest a static scene goes unrecognized
+        double cpu_cores = 0.0;                  // cores the camera's recognition may keep busy, 0 for no limit
+    };
+
+    struct Decision {
+        bool process = false;
+        double changed_fraction = 0.0;
+        std::vector<cv::Rect> regions;  // full-size regions to detect in, empty for the whole frame
+    };
+
+    explicit RecognitionScheduler(Params params = {});
+
+    // `tracked` are the boxes of the camera's current face tracks, detection always covers them
+    Decision evaluate(const cv::Mat& frame, const std::vector<cv::Rect>& tracked,
+        std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now());
+
+    // Time a processed frame took, which sets when the CPU budget allows the next one
+    void finished(std::chrono::steady_clock::duration processing,
+        std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now());
+
+private:
+    // Bounding boxes of the changed pixels, scaled to the frame
+    std::vector<cv::Rect> changedRegions(const cv::Mat& mask, double scale, const cv::Size& frame_size) const;
+
+    Params params;
+    cv::Mat gray;
+    cv::Mat background;  // CV_32F
+    std::chrono::steady_clock::time_point last_processed;
+    std::chrono::steady_clock::time_point next_allowed;
+    bool motion_pending = false;  // changes seen on frames the budget skipped
+};
@@ -13,17 +13,17 @@ bool RecognitionTracker::recognize(int user_id) {
     auto it = _last_recognition_time.find(user_id);
 
     //      
-    auto user_opt = _repository.findById(user_id);
+    auto user_opt = _repository.findSummary(user_id);
     if (!user_opt) {
         return false; //   
     }
 
     const auto& user = *user_opt;
-    auto attendance = user.getAttendance();
+    auto last_attendance_time = user.last_attendance;
     bool time_condition = false;
 
-    if (!attendance.empty()) {
-        auto last_attendance = std::chrono::system_clock::from_time_t(attendance.back());
+    if (last_attendance_time) {
+        auto last_attendance = std::chrono::system_clock::from_time_t(*last_attendance_time);
         time_condition = (now - last_attendance) >= TIME_THRESHOLD;
     }
     else {
@@ -36,13 +36,49 @@ bool RecognitionTracker::recognize(int user_id) {
         bool mark = markAttendedIfThresholdReached(user_id);
         return mark;
     }
+    return false;
+}
+
+bool RecognitionTracker::recognize(int user_id, int track_id, std::chrono::system_clock::time_point time,
+    const std::string& camera) {
+    auto& votes = _track_votes[track_id];
+    int user_votes = ++votes[user_id];
+    if (_attended_tracks.count(track_id) != 0 || user_votes < RECOGNITION_THRESHOLD) {
+        return false;
+    }
+
+    // A track that switched between people only counts when one identity clearly dominates it
+    int total_votes = 0;
+    for (const auto& [user, count] : votes) {
+        total_votes += count;
+    }
+    if (2 * user_votes <= total_votes) {
+        return false;
+    }
+
+    if (!_repository.findSummary(user_id)) {
+        return false;
+    }
+    _attended_tracks.insert(track_id);
+
+    // Recordings are not necessarily processed in chronological order, so any attendance close in time counts
+    std::time_t attended = std::chrono::system_clock::to_time_t(time);
+    if (_repository.attendedWithin(user_id, attended, TIME_THRESHOLD)) {
+        return false;
+    }
+    _repository.markAttended(user_id, attended, camera);
+    return true;
+}
+
+void RecognitionTracker::endTrack(int track_id) {
+    _track_votes.erase(track_id);
+    _attended_tracks.erase(track_id);
 }
 
  bool RecognitionTracker::markAttendedIfThresholdReached(int user_id) {
     if (_recognition_counts[user_id] >= RECOGNITION_THRESHOLD) {
-        if (auto user = _repository.findById(user_id)) {
-            user->markAttended();
-            _repository.update(*user);
+        if (auto user = _repository.findSummary(user_id)) {
+            _repository.markAttended(user_id, std::chrono::system_clock::to_time_t(std::chrono::system_clock::now()));
             _recognition_counts[user_id] = 0; //     
 
             return true;
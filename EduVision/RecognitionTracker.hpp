@@ -5,7 +5,9 @@
 #pragma once
 
 #include <unordered_map>
+#include <unordered_set>
 #include <chrono>
+#include <string>
 
 class UserRepository;
 
@@ -15,10 +17,19 @@ public:
 
     bool recognize(int user_id);
 
+    // One vote of a face track for `user_id`. Attendance is marked once per track, when its
+    // leading identity reaches RECOGNITION_THRESHOLD votes and holds the majority of them.
+    // `time` is when the face was seen, it is stored as the attendance time, and `camera` the camera or room.
+    bool recognize(int user_id, int track_id,
+        std::chrono::system_clock::time_point time = std::chrono::system_clock::now(), const std::string& camera = {});
+    void endTrack(int track_id);
+
 private:
     UserRepository& _repository;
     std::unordered_map<int, int> _recognition_counts;
     std::unordered_map<int, std::chrono::system_clock::time_point> _last_recognition_time;
+    std::unordered_map<int, std::unordered_map<int, int>> _track_votes;
+    std::unordered_set<int> _attended_tracks;
     static constexpr int RECOGNITION_THRESHOLD = 5;
     static constexpr std::chrono::minutes TIME_THRESHOLD = std::chrono::minutes(30);
 
@@ -0,0 +1,100 @@
+#define _SILENCE_CXX17_CODECVT_HEADER_DEPRECATION_WARNING
+#define _SILENCE_ALL_CXX17_DEPRECATION_WARNINGS
+#define _CRT_SECURE_NO_WARNINGS
+
+#include "SchemaMigrator.hpp"
+
+#include <sqlite3.h>
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <stdexcept>
+
+SchemaMigrator::Transaction::Transaction(sqlite3* db) : db(db) {
+    // Takes the write lock up front, a batch never has to upgrade a read lock halfway
+    execute(db, "BEGIN IMMEDIATE");
+}
+
+SchemaMigrator::Transaction::~Transaction() {
+    if (open) {
+        sqlite3_exec(db, "ROLLBACK", nullptr, nullptr, nullptr);
+    }
+}
+
+void SchemaMigrator::Transaction::commit() {
+    execute(db, "COMMIT");
+    open = false;
+}
+
+SchemaMigrator::SchemaMigrator(std::vector<Migration> migrations) : migrations(std::move(migrations)) {
+    std::sort(this->migrations.begin(), this->migrations.end(), [](const Migration& a, const Migration& b) {
+        return a.version < b.version;
+    });
+}
+
+int SchemaMigrator::migrate(const std::string& path, std::ostream& log) const {
+    sqlite3* handle = nullptr;
+    int result = sqlite3_open_v2(path.c_str(), &handle, SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE, nullptr);
+    std::unique_ptr<sqlite3, decltype(&sqlite3_close)> db(handle, &sqlite3_close);
+    if (result != SQLITE_OK) {
+        throw std::runtime_error("Unable to open " + path + ": " + sqlite3_errstr(result));
+    }
+    sqlite3_busy_timeout(db.get(), 5000);
+    // Readers go on while a batch is written
+    execute(db.get(), "PRAGMA journal_mode = WAL");
+
+    int current = version(db.get());
+    const int latest = migrations.empty() ? 0 : migrations.back().version;
+    if (current > latest) {
+        throw std::runtime_error(path + " is at schema version " + std::to_string(current)
+            + ", newer than the " + std::to_string(latest) + " this build knows");
+    }
+    for (const Migration& migration : migrations) {
+        if (migration.version <= current) {
+            continue;
+        }
+        log << "Migrating " << path << " to schema version " << migration.version << ": " << migration.description << std::endl;
+        const auto started = std::chrono::steady_clock::now();
+        if (migration.batched) {
+            migration.apply(db.get());
+        }
+        else {
+            Transaction transaction(db.get());
+            migration.apply(db.get());
+            setVersion(db.get(), migration.version);
+            transaction.commit();
+        }
+        current = version(db.get());
+        if (current != migration.version) {
+            throw std::runtime_error("Migration to schema version " + std::to_string(migration.version)
+                + " left " + path + " at version " + std::to_string(current));
+        }
+        log << "Schema version " << current << " reached in "
+            << std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count() << " s" << std::endl;
+    }
+    return current;
+}
+
+int SchemaMigrator::version(sqlite3* db) {
+    sqlite3_stmt* statement = nullptr;
+    if (sqlite3_prepare_v2(db, "PRAGMA user_version", -1, &statement, nullptr) != SQLITE_OK) {
+        throw std::runtime_error(std::string("Unable to read the schema version: ") + sqlite3_errmsg(db));
+    }
+    int result = sqlite3_step(statement) == SQLITE_ROW ? sqlite3_column_int(statement, 0) : 0;
+    sqlite3_finalize(statement);
+    return result;
+}
+
+void SchemaMigrator::setVersion(sqlite3* db, int version) {
+    // Part of the surrounding transaction, like any other write to the database header
+    execute(db, "PRAGMA user_version = " + std::to_string(version));
+}
+
+void SchemaMigrator::execute(sqlite3* db, const std::string& sql) {
+    char* error = nullptr;
+    if (sqlite3_exec(db, sql.c_str(), nullptr, nullptr, &error) != SQLITE_OK) {
+        std::string message = error != nullptr ? error : sqlite3_errmsg(db);
+        sqlite3_free(error);
+        throw std::runtime_error("SQL error: " + message);
+    }
+}
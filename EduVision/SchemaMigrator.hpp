@@ -0,0 +1,54 @@
+#pragma once
+
+#include <functional>
+#include <ostream>
+#include <string>
+#include <vector>
+
+struct sqlite3;
+
+// Versioned schema of an SQLite database. PRAGMA user_version holds the version a database
+// is at, and every migration above it runs once, in order, before the database is used.
+// A plain migration runs in one transaction together with its version bump. A batched one
+// commits as it goes, so other connections are only held up for one batch at a time; it has
+// to be resumable and bumps the version in its own last transaction.
+class SchemaMigrator {
+public:
+    struct Migration {
+        int version;            // the schema version the migration brings the database to
+        std::string description;
+        std::function<void(sqlite3*)> apply;
+        bool batched = false;
+    };
+
+    // Commits on commit(), otherwise rolls back on destruction
+    class Transaction {
+    public:
+        explicit Transaction(sqlite3* db);
+        ~Transaction();
+
+        Transaction(const Transaction&) = delete;
+        Transaction& operator=(const Transaction&) = delete;
+
+        void commit();
+
+    private:
+        sqlite3* db;
+        bool open = true;
+    };
+
+    explicit SchemaMigrator(std::vector<Migration> migrations);
+
+    // Brings the database at `path` to the latest version on a connection of its own and returns
+    // that version. Throws when a migration fails or the database is newer than the migrations.
+    int migrate(const std::string& path, std::ostream& log) const;
+
+    static int version(sqlite3* db);
+    static void setVersion(sqlite3* db, int version);
+
+    // Runs one or more statements, throws with SQLite's message on failure
+    static void execute(sqlite3* db, const std::string& sql);
+
+private:
+    std::vector<Migration> migrations;
+};
@@ -0,0 +1,35 @@
+#define _SILENCE_CXX17_CODECVT_HEADER_DEPRECATION_WARNING
+#define _SILENCE_ALL_CXX17_DEPRECATION_WARNINGS
+#define _CRT_SECURE_NO_WARNINGS
+
+#include "SharedGallery.hpp"
+
+SharedGallery::SharedGallery(DescriptorGallery gallery)
+    : current(std::make_shared<const DescriptorGallery>(std::move(gallery))) {
+}
+
+std::shared_ptr<const DescriptorGallery> SharedGallery::load() const {
+    std::lock_guard<std::mutex> lock(current_mutex);
+    return current;
+}
+
+void SharedGallery::update(const std::function<void(DescriptorGallery&)>& change) {
+    std::lock_guard<std::mutex> lock(writer_mutex);
+    auto next = std::make_shared<DescriptorGallery>(*load());
+    change(*next);
+    swapCurrent(std::move(next));
+}
+
+void SharedGallery::publish(std::shared_ptr<const DescriptorGallery> gallery) {
+    std::lock_guard<std::mutex> lock(writer_mutex);
+    swapCurrent(std::move(gallery));
+}
+
+void SharedGallery::swapCurrent(std::shared_ptr<const DescriptorGallery> gallery) {
+    {
+        std::lock_guard<std::mutex> lock(current_mutex);
+        current.swap(gallery);
+    }
+    ++version;
+    // `gallery` now holds the previous snapshot, freed here outside the lock when no reader has it
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+
+#include "DescriptorGallery.hpp"
+
+// The gallery the recognition thread matches against, published as immutable
+// snapshots (read-copy-update). Readers take a snapshot per frame and only
+// contend for the pointer copy, never for a writer's work; a writer copies the
+// current snapshot, changes the copy and swaps it in. Old snapshots are freed when the last reader drops them.
+class SharedGallery {
+public:
+    explicit SharedGallery(DescriptorGallery gallery);
+
+    [[nodiscard]] std::shared_ptr<const DescriptorGallery> load() const;
+
+    // Applies `change` to a copy of the current snapshot and publishes it. Writers are serialized.
+    void update(const std::function<void(DescriptorGallery&)>& change);
+    void publish(std::shared_ptr<const DescriptorGallery> gallery);
+
+    // Incremented on every publish
+    [[nodiscard]] uint64_t getVersion() const { return version.load(); }
+
+private:
+    void swapCurrent(std::shared_ptr<const DescriptorGallery> gallery);
+
+    // Held only to copy or swap the pointer, never while a gallery is built
+    mutable std::mutex current_mutex;
+    std::shared_ptr<const DescriptorGallery> current;
+    std::mutex writer_mutex;
+    std::atomic<uint64_t> version{ 0 };
+};
@@ -3,8 +3,14 @@
 #define _CRT_SECURE_NO_WARNINGS
 
 #include "User.hpp"
+#include "Metrics.hpp"
+#include "SchemaMigrator.hpp"
 #include <sqlite_orm/sqlite_orm.h>
+#include <algorithm>
+#include <ctime>
 #include <memory>
+#include <mutex>
+#include <unordered_map>
 #include <iostream>
 
 User::User(std::string name, std::string surname, std::string patronymic,
@@ -39,11 +45,13 @@ auto User::getPhotoPath() const -> std::string {
 
 auto User::markAttended() -> void { _attendance.emplace_back(_persist._id); }
 
+auto User::markAttended(std::time_t time) -> void { _attendance.emplace_back(_persist._id, time); }
+
 auto User::getAttendance() const -> std::vector<std::time_t> {
     std::vector<std::time_t> out;
     out.reserve(_attendance.size());
     for (const auto& attendance : _attendance) {
-        out.push_back(std::stoll(attendance._datetime));
+        out.push_back(static_cast<std::time_t>(attendance._datetime));
     }
     return out;
 }
@@ -63,64 +71,367 @@ auto operator<<(std::ostream& os, const User& c) -> std::ostream& {
     return out << "]";
 }
 
-static auto storage = sqlite_orm::make_storage(
-    "local.db",
-    sqlite_orm::make_table(
-        "users",
-        sqlite_orm::make_column("id", &User::UserPersist::_id,
-            sqlite_orm::primary_key().autoincrement()),
-        sqlite_orm::make_column("name", &User::UserPersist::_name),
-        sqlite_orm::make_column("surname", &User::UserPersist::_surname),
-        sqlite_orm::make_column("patronymic", &User::UserPersist::_patronymic),
-        sqlite_orm::make_column("group", &User::UserPersist::_group),
-        sqlite_orm::make_column("photo_path", &User::UserPersist::_photo_path)),
-    sqlite_orm::make_table(
-        "attendance",
-        sqlite_orm::make_column("id", &User::AttendancePersist::_id,
-            sqlite_orm::primary_key().autoincrement()),
-        sqlite_orm::make_column("user_id", &User::AttendancePersist::_user_id),
-        sqlite_orm::make_column("datetime",
-            &User::AttendancePersist::_datetime)));
+static constexpr const char* DATABASE_PATH = "local.db";
+
+// Mapping of the tables only, the schema itself is created and changed by localDbMigrations()
+static auto makeStorage() {
+    return sqlite_orm::make_storage(
+        DATABASE_PATH,
+        sqlite_orm::make_table(
+            "users",
+            sqlite_orm::make_column("id", &User::UserPersist::_id,
+                sqlite_orm::primary_key().autoincrement()),
+            sqlite_orm::make_column("name", &User::UserPersist::_name),
+            sqlite_orm::make_column("surname", &User::UserPersist::_surname),
+            sqlite_orm::make_column("patronymic", &User::UserPersist::_patronymic),
+            sqlite_orm::make_column("group", &User::UserPersist::_group),
+            sqlite_orm::make_column("photo_path", &User::UserPersist::_photo_path)),
+        sqlite_orm::make_table(
+            "attendance",
+            sqlite_orm::make_column("id", &User::AttendancePersist::_id,
+                sqlite_orm::primary_key().autoincrement()),
+            sqlite_orm::make_column("user_id", &User::AttendancePersist::_user_id),
+            sqlite_orm::make_column("datetime",
+                &User::AttendancePersist::_datetime),
+            sqlite_orm::make_column("camera", &User::AttendancePersist::_camera)));
+}
+
+static auto storage = makeStorage();
+
+namespace {
+    // Settings of a connection to local.db, both connections stay open for the whole run
+    void configureConnection(sqlite3* db) {
+        const char* pragmas =
+            "PRAGMA journal_mode = WAL;"       // readers do not wait for the writer connection's transactions
+            "PRAGMA synchronous = NORMAL;"     // with WAL a commit survives an application crash, only an OS crash may lose the last ones
+            "PRAGMA cache_size = -32768;"      // 32 MiB page cache
+            "PRAGMA temp_store = MEMORY;"
+            "PRAGMA mmap_size = 268435456;"
+            "PRAGMA busy_timeout = 5000;";
+        char* error = nullptr;
+        if (sqlite3_exec(db, pragmas, nullptr, nullptr, &error) != SQLITE_OK) {
+            std::cerr << "Error configuring local.db: " << (error != nullptr ? error : "unknown error") << std::endl;
+            sqlite3_free(error);
+        }
+    }
+
+    constexpr int MIGRATION_BATCH_ROWS = 10000;
+
+    // Version 2: attendance time as an INTEGER epoch instead of its decimal text, and a camera column.
+    // SQLite can not change a column's type, so the rows are copied into a new table in id order, one
+    // short transaction per batch; an interrupted run continues after the last copied row. The last
+    // transaction copies what was written meanwhile and swaps the tables.
+    void migrateAttendanceToEpoch(sqlite3* db) {
+        SchemaMigrator::execute(db, R"(CREATE TABLE IF NOT EXISTS "attendance_v2" (
+            "id" INTEGER PRIMARY KEY AUTOINCREMENT NOT NULL,
+            "user_id" INTEGER NOT NULL,
+            "datetime" INTEGER NOT NULL,
+            "camera" TEXT))");
+        const std::string copy = R"(INSERT INTO "attendance_v2" ("id", "user_id", "datetime")
+            SELECT "id", "user_id", CAST("datetime" AS INTEGER) FROM "attendance"
+            WHERE "id" > (SELECT IFNULL(MAX("id"), 0) FROM "attendance_v2") ORDER BY "id")";
+        int copied = 0;
+        do {
+            SchemaMigrator::Transaction transaction(db);
+            SchemaMigrator::execute(db, copy + " LIMIT " + std::to_string(MIGRATION_BATCH_ROWS));
+            copied = sqlite3_changes(db);
+            transaction.commit();
+        } while (copied > 0);
+
+        SchemaMigrator::Transaction transaction(db);
+        // Attendance rows are only ever inserted or deleted, never updated
+        SchemaMigrator::execute(db, copy);
+        SchemaMigrator::execute(db, R"(DELETE FROM "attendance_v2" WHERE "id" NOT IN (SELECT "id" FROM "attendance"))");
+        SchemaMigrator::execute(db, R"(DROP TABLE "attendance")");
+        SchemaMigrator::execute(db, R"(ALTER TABLE "attendance_v2" RENAME TO "attendance")");
+        // Covers the per-user and time range queries, and idx_attendance_user_id went with the old table
+        SchemaMigrator::execute(db, R"(CREATE INDEX "idx_attendance_user_datetime" ON "attendance" ("user_id", "datetime"))");
+        SchemaMigrator::setVersion(db, 2);
+        transaction.commit();
+    }
+
+    std::vector<SchemaMigrator::Migration> localDbMigrations() {
+        return {
+            // The schema sync_schema() used to create, a database made before versioning already has it
+            { 1, "users and attendance tables", [](sqlite3* db) {
+                SchemaMigrator::execute(db, R"(
+                    CREATE TABLE IF NOT EXISTS "users" (
+                        "id" INTEGER PRIMARY KEY AUTOINCREMENT NOT NULL,
+                        "name" TEXT NOT NULL,
+                        "surname" TEXT NOT NULL,
+                        "patronymic" TEXT NOT NULL,
+                        "group" TEXT,
+                        "photo_path" TEXT);
+                    CREATE TABLE IF NOT EXISTS "attendance" (
+                        "id" INTEGER PRIMARY KEY AUTOINCREMENT NOT NULL,
+                        "user_id" INTEGER NOT NULL,
+                        "datetime" TEXT NOT NULL);
+                    CREATE INDEX IF NOT EXISTS "idx_attendance_user_id" ON "attendance" ("user_id");
+                    CREATE INDEX IF NOT EXISTS "idx_users_group" ON "users" ("group");
+                    CREATE INDEX IF NOT EXISTS "idx_users_name_surname" ON "users" ("name", "surname");)");
+            } },
+            { 2, "attendance time as an INTEGER epoch, camera column", migrateAttendanceToEpoch, true },
+        };
+    }
+
+    // Connection of the attendance writer thread alone. Its batch transactions and the rowids of its
+    // inserts stay apart from the connection every other thread uses.
+    auto& writerStorage() {
+        static auto connection = makeStorage();
+        return connection;
+    }
+
+    void initializeStorage() {
+        static std::once_flag initialized;
+        std::call_once(initialized, [] {
+            // Before the storage opens, sync_schema() is not used as it would recreate a table whose columns changed
+            SchemaMigrator(localDbMigrations()).migrate(DATABASE_PATH, std::cout);
+            storage.on_open = configureConnection;
+            // Pragmas and prepared statements belong to a connection, so it is opened once and kept.
+            // Every thread but the attendance writer shares it.
+            storage.open_forever();
+            writerStorage().on_open = configureConnection;
+            writerStorage().open_forever();
+        });
+    }
+
+    // The queries of the lookup paths, prepared once. A statement is bound and stepped by one thread at a time.
+    std::mutex statements_mutex;
+
+    // Writes on the shared connection, one at a time: insert() returns the connection's last insert rowid,
+    // which an insert of another thread would change in between
+    std::mutex writes_mutex;
+
+    auto& userByIdStatement() {
+        static auto statement = storage.prepare(sqlite_orm::get<User::UserPersist>(0));
+        return statement;
+    }
+
+    auto& attendanceByUserStatement() {
+        using namespace sqlite_orm; // NOLINT
+        static auto statement = storage.prepare(get_all<User::AttendancePersist>(
+            where(c(&User::AttendancePersist::_user_id) == 0)));
+        return statement;
+    }
+
+    auto& lastAttendanceStatement() {
+        using namespace sqlite_orm; // NOLINT
+        static auto statement = storage.prepare(select(max(&User::AttendancePersist::_datetime),
+            where(c(&User::AttendancePersist::_user_id) == 0)));
+        return statement;
+    }
+
+    // Answered from the (user_id, datetime) index alone
+    auto& attendanceBetweenStatement() {
+        using namespace sqlite_orm; // NOLINT
+        static auto statement = storage.prepare(select(&User::AttendancePersist::_id,
+            where(c(&User::AttendancePersist::_user_id) == 0
+                and c(&User::AttendancePersist::_datetime) > 0LL and c(&User::AttendancePersist::_datetime) < 0LL),
+            limit(1)));
+        return statement;
+    }
+
+    auto& usersByGroupStatement() {
+        using namespace sqlite_orm; // NOLINT
+        static auto statement = storage.prepare(get_all<User::UserPersist>(
+            where(c(&User::UserPersist::_group) == std::string())));
+        return statement;
+    }
+
+    auto& usersByFullNameStatement() {
+        using namespace sqlite_orm; // NOLINT
+        static auto statement = storage.prepare(get_all<User::UserPersist>(
+            where(c(&User::UserPersist::_name) == std::string() and c(&User::UserPersist::_surname) == std::string())));
+        return statement;
+    }
+
+    // Local midnight of the day a time falls on. The last day is remembered, consecutive times mostly share it.
+    class DayOf {
+    public:
+        std::time_t operator()(std::time_t time) {
+            if (time < start || time >= end) {
+                std::tm day = *std::localtime(&time);
+                day.tm_sec = 0;
+                day.tm_min = 0;
+                day.tm_hour = 0;
+                day.tm_isdst = -1;
+                start = std::mktime(&day);
+                day.tm_mday += 1;
+                day.tm_isdst = -1;
+                end = std::mktime(&day);
+            }
+            return start;
+        }
+
+    private:
+        std::time_t start = 0;
+        std::time_t end = 0;
+    };
+}
 
 void UserRepository::create(User& user) {
+    Metrics::Timer timer(Metrics::Stage::RepositoryWrite);
+    std::lock_guard<std::mutex> write_lock(writes_mutex);
     int id = storage.insert(user._persist);
     user._persist._id = id;
+    invalidate(id);
+    std::lock_guard<std::mutex> lock(_dailyMutex);
     for (auto& attendance : user._attendance) {
         attendance._user_id = id;
         int attendance_id = storage.insert(attendance);
         attendance._id = attendance_id;
+        count_daily(id, static_cast<std::time_t>(attendance._datetime));
     }
 }
 
 void UserRepository::update(User& user) {
+    Metrics::Timer timer(Metrics::Stage::RepositoryWrite);
+    std::lock_guard<std::mutex> write_lock(writes_mutex);
     storage.update(user._persist);
+    invalidate(user.getId());
+    std::lock_guard<std::mutex> lock(_dailyMutex);
     for (auto& attendance : user._attendance) {
         if (attendance._id == -1) {
             int attendance_id = storage.insert(attendance);
             attendance._id = attendance_id;
+            count_daily(user.getId(), static_cast<std::time_t>(attendance._datetime));
         }
     }
 }
 
 void UserRepository::remove(int id) {
-    storage.remove<User::UserPersist>(id);
-    storage.remove_all<User::AttendancePersist>(sqlite_orm::where(
-        sqlite_orm::c(&User::AttendancePersist::_user_id) == id));
+    Metrics::Timer timer(Metrics::Stage::RepositoryWrite);
+    {
+        std::lock_guard<std::mutex> write_lock(writes_mutex);
+        storage.remove<User::UserPersist>(id);
+        // Lookups miss from here on, so recognition stops queueing attendance for the user. What is still
+        // queued is dropped, and a batch being written is waited for, so the DELETE below leaves no rows behind.
+        invalidate(id);
+        _attendanceWriter.discard(id);
+        storage.remove_all<User::AttendancePersist>(sqlite_orm::where(
+            sqlite_orm::c(&User::AttendancePersist::_user_id) == id));
+    }
+    {
+        std::lock_guard<std::mutex> lock(_dailyMutex);
+        _daily.erase(id);
+    }
+    invalidate(id);
+}
+
+void UserRepository::invalidate(int id) {
+    {
+        std::lock_guard<std::mutex> lock(_cacheMutex);
+        _cache.erase(id);
+    }
+    ++_reportVersion;
+}
+
+auto UserRepository::findSummary(int id) const -> std::shared_ptr<const UserSummary> {
+    // Misses load under the lock, so a concurrent markAttended can not be overwritten by an older load
+    std::lock_guard<std::mutex> lock(_cacheMutex);
+    auto it = _cache.find(id);
+    if (it != _cache.end()) {
+        return it->second;
+    }
+
+    Metrics::Timer timer(Metrics::Stage::RepositoryRead);
+    // Before the query: a batch committed in between is then in the table, not lost between the two reads
+    const std::vector<AttendanceWriter::Record> pending = _attendanceWriter.pending();
+    std::shared_ptr<UserSummary> summary;
+    try {
+        std::lock_guard<std::mutex> statements_lock(statements_mutex);
+        auto& user_statement = userByIdStatement();
+        sqlite_orm::get<0>(user_statement) = id;
+        User::UserPersist user = storage.execute(user_statement);
+        summary = std::make_shared<UserSummary>(UserSummary{ id, user._name, user._surname, user._group ? *user._group : std::string() });
+
+        auto& last_statement = lastAttendanceStatement();
+        sqlite_orm::get<0>(last_statement) = id;
+        auto last = storage.execute(last_statement);
+        if (!last.empty() && last.front()) {
+            summary->last_attendance = static_cast<std::time_t>(*last.front());
+        }
+    }
+    catch (std::system_error& e) {
+        if (e.code() != sqlite_orm::orm_error_code::not_found) {
+            throw;
+        }
+    }
+    if (summary) {
+        for (const AttendanceWriter::Record& record : pending) {
+            if (record.user_id == id && (!summary->last_attendance || *summary->last_attendance < record.time)) {
+                summary->last_attendance = record.time;
+            }
+        }
+    }
+    return _cache.emplace(id, std::move(summary)).first->second;
+}
+
+auto UserRepository::attendedWithin(int user_id, std::time_t time, std::chrono::seconds window) const -> bool {
+    // Before the query, as in enrich_attendance
+    for (const AttendanceWriter::Record& record : _attendanceWriter.pending()) {
+        if (record.user_id == user_id && record.time > time - window.count() && record.time < time + window.count()) {
+            return true;
+        }
+    }
+    Metrics::Timer timer(Metrics::Stage::RepositoryRead);
+    std::lock_guard<std::mutex> lock(statements_mutex);
+    auto& statement = attendanceBetweenStatement();
+    sqlite_orm::get<0>(statement) = user_id;
+    sqlite_orm::get<1>(statement) = static_cast<long long>(time - window.count());
+    sqlite_orm::get<2>(statement) = static_cast<long long>(time + window.count());
+    return !storage.execute(statement).empty();
 }
 
 void UserRepository::enrich_attendance(int id, User& user) const {
-    using namespace sqlite_orm; // NOLINT 
-    auto attendance_persists = storage.get_all<User::AttendancePersist>(
-        where(c(&User::AttendancePersist::_user_id) == id));
+    // Before the query: a batch committed in between is then in the rows, not lost between the two reads
+    const std::vector<AttendanceWriter::Record> pending = _attendanceWriter.pending();
+    std::vector<User::AttendancePersist> attendance_persists;
+    {
+        std::lock_guard<std::mutex> lock(statements_mutex);
+        auto& statement = attendanceByUserStatement();
+        sqlite_orm::get<0>(statement) = id;
+        attendance_persists = storage.execute(statement);
+    }
     for (auto& attendancePersist : attendance_persists) {
         user._attendance.emplace_back(std::move(attendancePersist));
     }
+    merge_pending_attendance(pending, user);
+}
+
+void UserRepository::merge_pending_attendance(const std::vector<AttendanceWriter::Record>& pending, User& user,
+    std::optional<AttendanceRange> range) {
+    // A record may have been committed after the snapshot, it is then among the rows already
+    auto stored = user.getAttendance();
+    bool added = false;
+    for (const AttendanceWriter::Record& record : pending) {
+        if (record.user_id != user.getId() || (range && (record.time < range->from || record.time >= range->to))) {
+            continue;
+        }
+        if (std::find(stored.begin(), stored.end(), record.time) == stored.end()) {
+            User::AttendancePersist attendance(record.user_id, record.time, record.camera);
+            attendance._id = 0; // Not inserted again by update()
+            user._attendance.push_back(std::move(attendance));
+            stored.push_back(record.time);
+            added = true;
+        }
+    }
+    if (!added) {
+        return;
+    }
+    std::sort(user._attendance.begin(), user._attendance.end(), [](const auto& a, const auto& b) {
+        return a._datetime < b._datetime;
+    });
 }
 
 auto UserRepository::findById(int id) const -> std::optional<User> {
+    Metrics::Timer timer(Metrics::Stage::RepositoryRead);
     try {
-        auto user_persist = storage.get<User::UserPersist>(id);
-        auto user = User{ std::move(user_persist) };
+        std::unique_lock<std::mutex> lock(statements_mutex);
+        auto& statement = userByIdStatement();
+        sqlite_orm::get<0>(statement) = id;
+        auto user = User{ storage.execute(statement) };
+        lock.unlock();
         enrich_attendance(id, user);
         return user;
     }
@@ -133,28 +444,69 @@ auto UserRepository::findById(int id) const -> std::optional<User> {
     }
 }
 
-auto UserRepository::getAll() const -> std::vector<User> {
+auto UserRepository::assemble_users(std::vector<User::UserPersist> user_persists,
+    std::vector<User::AttendancePersist> attendance_persists) -> std::vector<User> {
     std::vector<User> users;
-    for (auto& userPersist : storage.get_all<User::UserPersist>()) {
-        auto user = User(std::move(userPersist));
-        enrich_attendance(user.getId(), user);
-        users.emplace_back(std::move(user));
+    users.reserve(user_persists.size());
+    std::unordered_map<int, size_t> user_index;
+    for (auto& userPersist : user_persists) {
+        user_index[userPersist._id] = users.size();
+        users.emplace_back(std::move(userPersist));
+    }
+    for (auto& attendancePersist : attendance_persists) {
+        auto it = user_index.find(attendancePersist._user_id);
+        if (it != user_index.end()) {
+            users[it->second]._attendance.emplace_back(std::move(attendancePersist));
+        }
     }
     return users;
 }
 
-auto UserRepository::getAllByGroup(std::string group) const -> std::vector<User> {
+auto UserRepository::getAll(std::optional<AttendanceRange> range) const -> std::vector<User> {
+    Metrics::Timer timer(Metrics::Stage::RepositoryRead);
+    const std::vector<AttendanceWriter::Record> pending = _attendanceWriter.pending();
     using namespace sqlite_orm; // NOLINT
-    std::vector<User> users;
-    for (auto& userPersist : storage.get_all<User::UserPersist>(where(c(&User::UserPersist::_group) == group))) {
-        auto user = User(std::move(userPersist));
-        enrich_attendance(user.getId(), user);
-        users.emplace_back(std::move(user));
+    auto attendance_time = c(&User::AttendancePersist::_datetime);
+    auto user_persists = storage.get_all<User::UserPersist>();
+    auto attendance_persists = range
+        ? storage.get_all<User::AttendancePersist>(where(attendance_time >= range->from and attendance_time < range->to))
+        : storage.get_all<User::AttendancePersist>();
+
+    auto users = assemble_users(std::move(user_persists), std::move(attendance_persists));
+    for (auto& user : users) {
+        merge_pending_attendance(pending, user, range);
+    }
+    return users;
+}
+
+auto UserRepository::getAllByGroup(std::string group, std::optional<AttendanceRange> range) const -> std::vector<User> {
+    Metrics::Timer timer(Metrics::Stage::RepositoryRead);
+    const std::vector<AttendanceWriter::Record> pending = _attendanceWriter.pending();
+    using namespace sqlite_orm; // NOLINT
+    auto attendance_time = c(&User::AttendancePersist::_datetime);
+    auto group_members = select(&User::UserPersist::_id, where(c(&User::UserPersist::_group) == group));
+    std::vector<User::AttendancePersist> attendance_persists = range
+        ? storage.get_all<User::AttendancePersist>(where(in(&User::AttendancePersist::_user_id, group_members)
+            and attendance_time >= range->from and attendance_time < range->to))
+        : storage.get_all<User::AttendancePersist>(where(in(&User::AttendancePersist::_user_id, group_members)));
+
+    std::vector<User::UserPersist> user_persists;
+    {
+        std::lock_guard<std::mutex> lock(statements_mutex);
+        auto& statement = usersByGroupStatement();
+        sqlite_orm::get<0>(statement) = std::move(group);
+        user_persists = storage.execute(statement);
+    }
+
+    auto users = assemble_users(std::move(user_persists), std::move(attendance_persists));
+    for (auto& user : users) {
+        merge_pending_attendance(pending, user, range);
     }
     return users;
 }
 
 auto UserRepository::findUserByFullName(std::string name, std::string surname) const -> std::optional<User> {
+    Metrics::Timer timer(Metrics::Stage::RepositoryRead);
     using namespace sqlite_orm; // NOLINT
     try {
         if (name.empty() || surname.empty()) {
@@ -162,8 +514,14 @@ auto UserRepository::findUserByFullName(std::string name, std::string surname) c
         }
 
         //      sqlite_orm
-        auto user_persist = storage.get_all<User::UserPersist>(
-            where(c(&User::UserPersist::_name) == name and c(&User::UserPersist::_surname) == surname));
+        std::vector<User::UserPersist> user_persist;
+        {
+            std::lock_guard<std::mutex> lock(statements_mutex);
+            auto& statement = usersByFullNameStatement();
+            sqlite_orm::get<0>(statement) = std::move(name);
+            sqlite_orm::get<1>(statement) = std::move(surname);
+            user_persist = storage.execute(statement);
+        }
 
         // ,      
         if (!user_persist.empty()) {
@@ -190,13 +548,190 @@ auto UserRepository::findUserByFullName(std::string name, std::string surname) c
     }
 }
 
+void UserRepository::load_daily() const {
+    // Queued records are written first, the table then holds every attendance counted so far
+    if (!_attendanceWriter.flush()) {
+        throw std::runtime_error("Unable to write the queued attendance");
+    }
+    using namespace sqlite_orm; // NOLINT
+    // Read from idx_attendance_user_datetime alone, so each user's rows come in time order and DayOf rarely calls mktime
+    auto rows = storage.select(columns(&User::AttendancePersist::_user_id, &User::AttendancePersist::_datetime));
+    DayOf day_of;
+    _daily.clear();
+    for (const auto& row : rows) {
+        ++_daily[std::get<0>(row)][day_of(static_cast<std::time_t>(std::get<1>(row)))];
+    }
+    _dailyLoaded = true;
+}
+
+void UserRepository::count_daily(int user_id, std::time_t time) {
+    if (_dailyLoaded) {
+        ++_daily[user_id][DayOf()(time)];
+    }
+    ++_reportVersion;
+}
+
+auto UserRepository::build_report(std::vector<User::UserPersist> user_persists, std::optional<AttendanceRange> range,
+    uint64_t version) const -> AttendanceReport {
+    AttendanceReport report;
+    report.version = version;
+    // A day overlaps [from, to) when it starts before `to` and not before the day `from` falls on
+    const std::time_t first_day = range ? DayOf()(range->from) : 0;
+    auto in_range = [&](std::time_t day) {
+        return !range || (day >= first_day && day < range->to);
+    };
+
+    std::lock_guard<std::mutex> lock(_dailyMutex);
+    if (!_dailyLoaded) {
+        load_daily();
+    }
+    for (const auto& userPersist : user_persists) {
+        auto it = _daily.find(userPersist._id);
+        if (it == _daily.end()) {
+            continue;
+        }
+        for (const auto& [day, count] : it->second) {
+            if (in_range(day)) {
+                report.days.push_back(day);
+            }
+        }
+    }
+    std::sort(report.days.begin(), report.days.end());
+    report.days.erase(std::unique(report.days.begin(), report.days.end()), report.days.end());
+
+    report.rows.reserve(user_persists.size());
+    for (auto& userPersist : user_persists) {
+        AttendanceReport::Row row;
+        row.user_id = userPersist._id;
+        row.full_name = userPersist._surname + " " + userPersist._name + " " + userPersist._patronymic;
+        row.counts.assign(report.days.size(), 0);
+        auto it = _daily.find(userPersist._id);
+        if (it != _daily.end()) {
+            for (const auto& [day, count] : it->second) {
+                auto column = std::lower_bound(report.days.begin(), report.days.end(), day);
+                if (column != report.days.end() && *column == day) {
+                    row.counts[column - report.days.begin()] = count;
+                }
+            }
+        }
+        report.rows.push_back(std::move(row));
+    }
+
+    report.day_labels.reserve(report.days.size());
+    for (std::time_t day : report.days) {
+        char label[20];
+        std::strftime(label, sizeof(label), "%Y-%m-%d", std::localtime(&day));
+        report.day_labels.emplace_back(label);
+    }
+    return report;
+}
+
+auto UserRepository::getGroupReport(std::string group, std::optional<AttendanceRange> range) const -> AttendanceReport {
+    Metrics::Timer timer(Metrics::Stage::RepositoryRead);
+    // Taken first, a change made while the report is built leaves it stale rather than lost
+    const uint64_t version = reportVersion();
+    std::vector<User::UserPersist> user_persists;
+    {
+        std::lock_guard<std::mutex> lock(statements_mutex);
+        auto& statement = usersByGroupStatement();
+        sqlite_orm::get<0>(statement) = std::move(group);
+        user_persists = storage.execute(statement);
+    }
+    return build_report(std::move(user_persists), range, version);
+}
+
+auto UserRepository::getUserReport(int id, std::optional<AttendanceRange> range) const -> AttendanceReport {
+    Metrics::Timer timer(Metrics::Stage::RepositoryRead);
+    const uint64_t version = reportVersion();
+    std::vector<User::UserPersist> user_persists;
+    try {
+        std::lock_guard<std::mutex> lock(statements_mutex);
+        auto& statement = userByIdStatement();
+        sqlite_orm::get<0>(statement) = id;
+        user_persists.push_back(storage.execute(statement));
+    }
+    catch (std::system_error& e) {
+        if (e.code() != sqlite_orm::orm_error_code::not_found) {
+            throw;
+        }
+    }
+    return build_report(std::move(user_persists), range, version);
+}
+
+auto UserRepository::reportVersion() const -> uint64_t {
+    return _reportVersion.load();
+}
+
 void UserRepository::clearDatabase() {
-    storage.remove_all<User::AttendancePersist>();
-    storage.remove_all<User::UserPersist>();
+    {
+        std::lock_guard<std::mutex> write_lock(writes_mutex);
+        storage.remove_all<User::UserPersist>();
+        // As in remove(): no user is found any more, then the queue is emptied before the attendance goes
+        {
+            std::lock_guard<std::mutex> lock(_cacheMutex);
+            _cache.clear();
+        }
+        _attendanceWriter.discardAll();
+        storage.remove_all<User::AttendancePersist>();
+    }
+    {
+        std::lock_guard<std::mutex> lock(_dailyMutex);
+        _daily.clear();
+        _dailyLoaded = false;
+    }
+    std::lock_guard<std::mutex> lock(_cacheMutex);
+    _cache.clear();
+    ++_reportVersion;
 }
 
-UserRepository::UserRepository() : _recognitionTracker(*this) { storage.sync_schema(); }
+UserRepository::UserRepository()
+    : _recognitionTracker(*this),
+    _attendanceWriter([](const std::vector<AttendanceWriter::Record>& records) {
+        // One transaction, and so one sync, for the whole batch
+        auto& connection = writerStorage();
+        connection.transaction([&] {
+            for (const auto& record : records) {
+                User::AttendancePersist attendance(record.user_id, record.time, record.camera);
+                connection.insert(attendance);
+            }
+            return true;
+        });
+    }) {
+    initializeStorage();
+}
 
 bool UserRepository::recognize(int user_id) {
     return _recognitionTracker.recognize(user_id);
+}
+
+bool UserRepository::recognize(int user_id, int track_id, std::chrono::system_clock::time_point time,
+    const std::string& camera) {
+    return _recognitionTracker.recognize(user_id, track_id, time, camera);
+}
+
+void UserRepository::endTrack(int track_id) {
+    _recognitionTracker.endTrack(track_id);
+}
+
+void UserRepository::markAttended(int user_id, std::time_t time, const std::string& camera) {
+    {
+        // Counted and queued under one lock, so a load of the daily counts sees the record either
+        // in the table or afterwards, never both
+        std::lock_guard<std::mutex> lock(_dailyMutex);
+        count_daily(user_id, time);
+        _attendanceWriter.push(AttendanceWriter::Record{ user_id, time, camera });
+    }
+
+    std::lock_guard<std::mutex> lock(_cacheMutex);
+    auto it = _cache.find(user_id);
+    if (it != _cache.end() && it->second && (!it->second->last_attendance || *it->second->last_attendance < time)) {
+        // Readers may still hold the old summary, so it is replaced rather than changed
+        auto summary = std::make_shared<UserSummary>(*it->second);
+        summary->last_attendance = time;
+        it->second = std::move(summary);
+    }
+}
+
+bool UserRepository::flushAttendance() {
+    return _attendanceWriter.flush();
 }
\ No newline at end of file
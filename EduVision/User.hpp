@@ -4,12 +4,19 @@
 #define _SILENCE_ALL_CXX17_DEPRECATION_WARNINGS
 
 #include <sqlite_orm/sqlite_orm.h>
+#include <atomic>
+#include <cstdint>
 #include <ctime>
+#include <map>
 #include <memory>
+#include <mutex>
+#include <optional>
 #include <ostream>
 #include <string>
+#include <unordered_map>
 #include <vector>
 #include <chrono>
+#include "AttendanceWriter.hpp"
 #include "RecognitionTracker.hpp"
 
 class User {
@@ -29,14 +36,18 @@ public:
     struct AttendancePersist {
         int _id = -1;
         int _user_id = -1;
-        std::string _datetime;
+        long long _datetime = 0; // epoch seconds
+        std::unique_ptr<std::string> _camera; // camera or room the attendance was seen by, if known
 
         AttendancePersist() = default;
 
         explicit AttendancePersist(int user_id)
-            : _user_id(user_id),
-            _datetime(std::to_string(std::chrono::system_clock::to_time_t(
-                std::chrono::system_clock::now()))) {}
+            : AttendancePersist(user_id, std::chrono::system_clock::to_time_t(
+                std::chrono::system_clock::now())) {}
+
+        AttendancePersist(int user_id, std::time_t time, const std::string& camera = {})
+            : _user_id(user_id), _datetime(static_cast<long long>(time)),
+            _camera(camera.empty() ? nullptr : std::make_unique<std::string>(camera)) {}
     };
 
 public:
@@ -63,6 +74,9 @@ public:
 
     auto markAttended() -> void;
 
+    // Attendance at a given time, e.g. the moment of a recorded lecture
+    auto markAttended(std::time_t time) -> void;
+
     [[nodiscard]] auto getAttendance() const->std::vector<std::time_t>;
 
 private:
@@ -72,6 +86,36 @@ private:
 
 auto operator<<(std::ostream& os, const User& c)->std::ostream&;
 
+// Attendance times in [from, to)
+struct AttendanceRange {
+    std::time_t from;
+    std::time_t to;
+};
+
+// What the recognition path needs of a user, served by UserRepository from memory
+struct UserSummary {
+    int id = -1;
+    std::string name;
+    std::string surname;
+    std::string group;
+    std::optional<std::time_t> last_attendance; // latest attendance, queued ones included
+};
+
+// Attendance per user and local calendar day, as the report tables show it. Built from the daily
+// counts UserRepository keeps, so building a report reads no attendance rows.
+struct AttendanceReport {
+    struct Row {
+        int user_id = -1;
+        std::string full_name;   // surname, name and patronymic
+        std::vector<int> counts; // attendances on each of `days`
+    };
+
+    std::vector<std::time_t> days;       // local midnights with any attendance, ascending
+    std::vector<std::string> day_labels; // days as YYYY-MM-DD
+    std::vector<Row> rows;
+    uint64_t version = 0;                // UserRepository::reportVersion() the report was built at
+};
+
 class UserRepository {
 public:
     UserRepository();
@@ -86,16 +130,81 @@ public:
 
     bool recognize(int user_id);
 
+    bool recognize(int user_id, int track_id,
+        std::chrono::system_clock::time_point time = std::chrono::system_clock::now(), const std::string& camera = {});
+
+    void endTrack(int track_id);
+
+    // Queues an attendance for the writer thread, it is visible to find*/getAll* right away.
+    // `camera` names the camera or room that saw it, empty when unknown.
+    void markAttended(int user_id, std::time_t time, const std::string& camera = {});
+
+    // Writes every queued attendance to the database before returning
+    bool flushAttendance();
+
     [[nodiscard]] auto findById(int id) const->std::optional<User>;
 
-    [[nodiscard]] auto getAll() const->std::vector<User>;
+    // Cached display fields and last attendance of a user, null when the user does not exist. Only the first
+    // lookup after a change queries the database; a summary is never changed, a new attendance replaces it.
+    [[nodiscard]] auto findSummary(int id) const->std::shared_ptr<const UserSummary>;
+
+    // True when the user has an attendance less than `window` before or after `time`, queued ones included.
+    // A range query on the (user_id, datetime) index, for recordings processed out of order.
+    [[nodiscard]] auto attendedWithin(int user_id, std::time_t time, std::chrono::seconds window) const -> bool;
+
+    // Users with their attendance, only the attendance inside `range` when it is given. One query
+    // loads the users and one the attendance of all of them.
+    [[nodiscard]] auto getAll(std::optional<AttendanceRange> range = std::nullopt) const->std::vector<User>;
 
-    [[nodiscard]] auto getAllByGroup(std::string group) const->std::vector<User>;
+    [[nodiscard]] auto getAllByGroup(std::string group, std::optional<AttendanceRange> range = std::nullopt) const->std::vector<User>;
 
     [[nodiscard]] auto findUserByFullName(std::string name, std::string surname) const->std::optional<User>;
 
+    // Daily attendance of a group, only the days overlapping `range` when it is given
+    [[nodiscard]] auto getGroupReport(std::string group, std::optional<AttendanceRange> range = std::nullopt) const->AttendanceReport;
+
+    [[nodiscard]] auto getUserReport(int id, std::optional<AttendanceRange> range = std::nullopt) const->AttendanceReport;
+
+    // Changes with every attendance and every change to a user; a report built at an older version is stale
+    [[nodiscard]] auto reportVersion() const -> uint64_t;
+
 private:
     void enrich_attendance(int id, User& user) const;
 
+    // Adds the records of `pending` that belong to the user and are not among the rows read, `pending`
+    // being the writer's snapshot taken before the rows were
+    static void merge_pending_attendance(const std::vector<AttendanceWriter::Record>& pending, User& user,
+        std::optional<AttendanceRange> range = std::nullopt);
+
+    // Hands every attendance row to the user it belongs to
+    static auto assemble_users(std::vector<User::UserPersist> user_persists,
+        std::vector<User::AttendancePersist> attendance_persists)->std::vector<User>;
+
+    void invalidate(int id);
+
+    // Builds the report rows of `user_persists` from the daily counts, loading them on first use
+    auto build_report(std::vector<User::UserPersist> user_persists, std::optional<AttendanceRange> range,
+        uint64_t version) const->AttendanceReport;
+
+    // Loads the daily counts of the whole attendance table, with _dailyMutex held
+    void load_daily() const;
+
+    // Adds one attendance to the daily counts, with _dailyMutex held
+    void count_daily(int user_id, std::time_t time);
+
     RecognitionTracker _recognitionTracker;
+    // Mutable as reports flush it before loading the daily counts
+    mutable AttendanceWriter _attendanceWriter;
+
+    // Written through by markAttended, invalidated by create/update/remove. Users that do not
+    // exist are cached as well, as null.
+    mutable std::mutex _cacheMutex;
+    mutable std::unordered_map<int, std::shared_ptr<const UserSummary>> _cache;
+
+    // Attendance count per user and local midnight. Loaded by the first report, then kept up to date
+    // by every write of attendance, so reports never reread the attendance table.
+    mutable std::mutex _dailyMutex;
+    mutable bool _dailyLoaded = false;
+    mutable std::unordered_map<int, std::map<std::time_t, int>> _daily;
+    std::atomic<uint64_t> _reportVersion{ 0 };
 };
\ No newline at end of file
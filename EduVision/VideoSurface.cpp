@@ -0,0 +1,104 @@
+#define _SILENCE_CXX17_CODECVT_HEADER_DEPRECATION_WARNING
+#define _SILENCE_ALL_CXX17_DEPRECATION_WARNINGS
+#define _CRT_SECURE_NO_WARNINGS
+
+#include "VideoSurface.hpp"
+
+#include <opencv2/imgproc.hpp>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+VideoSurface::~VideoSurface() {
+    release();
+}
+
+void VideoSurface::release() {
+    if (texture_id != 0) {
+        glDeleteTextures(1, &texture_id);
+        texture_id = 0;
+    }
+    if (pixel_buffers[0] != 0) {
+        glDeleteBuffers(static_cast<GLsizei>(pixel_buffers.size()), pixel_buffers.data());
+        pixel_buffers = {};
+    }
+    frame_width = 0;
+    frame_height = 0;
+    frame_bytes = 0;
+}
+
+void VideoSurface::allocate(int width, int height) {
+    release();
+    frame_width = width;
+    frame_height = height;
+    frame_bytes = static_cast<size_t>(width) * height * 3;
+
+    glGenTextures(1, &texture_id);
+    glBindTexture(GL_TEXTURE_2D, texture_id);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    // Storage only, the pixels come with the first update
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB8, width, height, 0, GL_BGR, GL_UNSIGNED_BYTE, nullptr);
+
+    glGenBuffers(static_cast<GLsizei>(pixel_buffers.size()), pixel_buffers.data());
+    for (GLuint buffer : pixel_buffers) {
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffer);
+        glBufferData(GL_PIXEL_UNPACK_BUFFER, static_cast<GLsizeiptr>(frame_bytes), nullptr, GL_STREAM_DRAW);
+    }
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    next_buffer = 0;
+}
+
+void VideoSurface::update(const cv::Mat& frame) {
+    if (frame.empty()) {
+        return;
+    }
+    const cv::Mat* bgr = &frame;
+    if (frame.type() != CV_8UC3) {
+        if (frame.type() == CV_8UC1) {
+            cv::cvtColor(frame, converted, cv::COLOR_GRAY2BGR);
+        }
+        else if (frame.type() == CV_8UC4) {
+            cv::cvtColor(frame, converted, cv::COLOR_BGRA2BGR);
+        }
+        else {
+            throw std::invalid_argument("Unsupported frame type " + std::to_string(frame.type()));
+        }
+        bgr = &converted;
+    }
+    if (texture_id == 0 || bgr->cols != frame_width || bgr->rows != frame_height) {
+        allocate(bgr->cols, bgr->rows);
+    }
+
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pixel_buffers[next_buffer]);
+    next_buffer = (next_buffer + 1) % pixel_buffers.size();
+    // Orphaning hands out fresh storage when the driver still reads the old one, instead of waiting for it
+    glBufferData(GL_PIXEL_UNPACK_BUFFER, static_cast<GLsizeiptr>(frame_bytes), nullptr, GL_STREAM_DRAW);
+    auto* pixels = static_cast<unsigned char*>(glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0,
+        static_cast<GLsizeiptr>(frame_bytes), GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT));
+    if (pixels == nullptr) {
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        throw std::runtime_error("Unable to map the pixel buffer");
+    }
+    const size_t row_bytes = static_cast<size_t>(frame_width) * 3;
+    if (bgr->isContinuous()) {
+        std::memcpy(pixels, bgr->data, frame_bytes);
+    }
+    else {
+        for (int y = 0; y < frame_height; ++y) {
+            std::memcpy(pixels + y * row_bytes, bgr->ptr(y), row_bytes);
+        }
+    }
+    // False when the buffer's contents were lost meanwhile, e.g. on a mode switch; the frame is skipped
+    if (glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER) == GL_TRUE) {
+        glBindTexture(GL_TEXTURE_2D, texture_id);
+        // Rows of 3-byte pixels are packed without padding
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        // Reads from the bound buffer and returns at once, the transfer runs on the GPU
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, frame_width, frame_height, GL_BGR, GL_UNSIGNED_BYTE, nullptr);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    }
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <opencv2/core.hpp>
+#include <array>
+#include <cstddef>
+
+// Camera frames streamed into one GL texture that lives as long as the surface. The texture is
+// allocated once per resolution and updated with glTexSubImage2D from two pixel buffer objects
+// in turn: while the GPU still transfers the previous frame out of one buffer, the next frame is
+// copied into the other, so an upload never waits for the one before it. Frames are uploaded as
+// BGR and the driver puts the channels in order, there is no conversion on the CPU.
+class VideoSurface {
+public:
+    VideoSurface() = default;
+    // Releases the GL objects, the context has to be current
+    ~VideoSurface();
+
+    VideoSurface(const VideoSurface&) = delete;
+    VideoSurface& operator=(const VideoSurface&) = delete;
+
+    // Uploads an 8-bit BGR frame, other types are converted first. Reallocates on a new resolution.
+    void update(const cv::Mat& frame);
+
+    // Deletes the texture and buffers while the context is still alive; the next update allocates them again
+    void release();
+
+    [[nodiscard]] GLuint texture() const { return texture_id; }
+    [[nodiscard]] int width() const { return frame_width; }
+    [[nodiscard]] int height() const { return frame_height; }
+    [[nodiscard]] bool empty() const { return texture_id == 0; }
+
+private:
+    void allocate(int width, int height);
+
+    GLuint texture_id = 0;
+    std::array<GLuint, 2> pixel_buffers{};
+    size_t next_buffer = 0;
+    int frame_width = 0;
+    int frame_height = 0;
+    size_t frame_bytes = 0;
+    cv::Mat converted;  // reused for frames that are not BGR
+};